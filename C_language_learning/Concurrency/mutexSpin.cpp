@@ -3,6 +3,20 @@
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include "bench.h"
+
+// SpinLock vs std::mutex: two threads take turns on one lock, N times each.
+// Each is run by the bench harness (warm-up, repeated runs, median with a
+// confidence interval) and reported as ns per lock/unlock pair. With --cpu
+// the two threads run on that core and on another one that doesn't share
+// it; on the same core a spinner would only burn its timeslice while the
+// lock holder waits to be scheduled.
+//
+// build: g++ -O2 -pthread -I../../os_learning/ostep-project/include mutexSpin.cpp -o mutexSpin
+// usage: mutexSpin [--reps=N] [--warmup=N] [--cpu=N] [--json=FILE]
 
 // SpinLock implementation
 class SpinLock {
@@ -43,28 +57,54 @@ void increment_mutex() {
     }
 }
 
-int main() {
-    auto start = std::chrono::high_resolution_clock::now();
+// Cores the two threads are pinned to; -1: wherever the scheduler puts them
+int cores[2] = {-1, -1};
 
-    std::thread t1(increment_spinlock);
-    std::thread t2(increment_spinlock);
+// Runs f on two threads at once
+template <typename F>
+void run_two(F f) {
+    auto on = [f](int core) {
+        return [f, core] {
+            if (core >= 0)
+                bench::pin_current_thread(core);
+            f();
+        };
+    };
+    std::thread t1(on(cores[0]));
+    std::thread t2(on(cores[1]));
     t1.join();
     t2.join();
+}
 
-    auto mid = std::chrono::high_resolution_clock::now();
-
-    std::thread t3(increment_mutex);
-    std::thread t4(increment_mutex);
-    t3.join();
-    t4.join();
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.reps = 7;
+    opts = bench::parse_args(argc, argv, opts);
 
-    auto end = std::chrono::high_resolution_clock::now();
+    // Pick the second core before the harness pins this thread to the first
+    if (opts.cpu >= 0) {
+        std::vector<int> siblings = bench::parse_cpulist(bench::read_sysfs(
+            "/sys/devices/system/cpu/cpu" + std::to_string(opts.cpu) + "/topology/thread_siblings_list"));
+        for (int c : bench::usable_cores())
+            if (c != opts.cpu && std::find(siblings.begin(), siblings.end(), c) == siblings.end()) {
+                cores[0] = opts.cpu;
+                cores[1] = c;
+                break;
+            }
+        if (cores[1] < 0)
+            std::cerr << "Warning: no second core; both threads share cpu " << opts.cpu << std::endl;
+    }
+    bench::Harness h("mutexSpin", opts);
 
-    std::chrono::duration<double> spin_time = mid - start;
-    std::chrono::duration<double> mutex_time = end - mid;
+    h.time("spinlock", [] { run_two(increment_spinlock); }, 2.0 * N);
+    h.time("mutex", [] { run_two(increment_mutex); }, 2.0 * N);
 
-    std::cout << "SpinLock counter: " << counter1 << ", Time: " << spin_time.count() << "s\n";
-    std::cout << "Mutex counter: "   << counter2 << ", Time: " << mutex_time.count() << "s\n";
+    // Every run adds 2N, so a lost update shows up as a remainder
+    long runs = h.options().warmup + h.options().reps;
+    std::cout << "SpinLock counter: " << counter1 << " (expected " << 2L * N * runs << ")\n";
+    std::cout << "Mutex counter: "   << counter2 << " (expected " << 2L * N * runs << ")\n";
+    h.print(stdout);
+    h.finish();
 
     return 0;
 }
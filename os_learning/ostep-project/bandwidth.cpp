@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "include/affinity.h"
+#include "include/cache_info.h"
+#include "include/bench.h"
+
+// STREAM-style memory bandwidth on 1..N pinned threads. The pointer chases in
+// cache.cpp and cachePointer.cpp have one load in flight at a time and so
+// measure latency; here every thread streams through its own arrays with
+// independent loads and stores, which is what saturates a cache or the
+// memory controller.
+//
+// Kernels (bytes counted as in STREAM, without write-allocate traffic):
+//   copy  c = a          16 B/elem     read   sum += a   8 B/elem
+//   scale b = s*c        16 B/elem     write  a = s      8 B/elem
+//   add   c = a + b      24 B/elem
+//   triad a = b + s*c    24 B/elem
+// Every kernel but read also runs with non-temporal (streaming) stores, which
+// skip the read-for-ownership and bypass the caches; they only make sense at
+// the DRAM level. Each kernel is built for SSE2, AVX2 and AVX-512 and run on
+// whichever the CPU supports.
+//
+// Working sets are sized from the discovered caches: half of L1d and of L2
+// per thread, half of the last level shared by all threads, and 4x the last
+// level for DRAM. Each point runs under the include/bench.h harness, and the
+// CSV has its median GB/s and the 95% confidence interval:
+//   level,threads,bytes_per_thread,isa,kernel,stores,gbps,ci_lo,ci_hi
+//
+// usage: bandwidth [-t max_threads] [-c cpulist] [-i sse2|avx2|avx512|scalar]
+//                  [-l L1,L2,L3,DRAM] [-m max_dram_bytes] [-o out.csv]
+//                  [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]
+
+// A kernel runs over one thread's slices of the arrays; n is a multiple of 64
+using Kernel = double (*)(double *a, double *b, double *c, size_t n, double s);
+
+enum { COPY, SCALE, ADD, TRIAD, READ, WRITE, NUM_KERNELS };
+
+struct KernelInfo
+{
+    const char *name;
+    int bytes_per_elem;
+};
+
+const KernelInfo kernel_info[NUM_KERNELS] = {
+    {"copy", 16}, {"scale", 16}, {"add", 24}, {"triad", 24}, {"read", 8}, {"write", 8},
+};
+
+// One body for every instruction set. V is the vector type holding W doubles;
+// STORE is either a regular or a streaming store. read keeps four
+// accumulators so that it is not bound by the latency of the adds.
+#define BW_KERNELS(ATTR, V, W, LOAD, STORE, SET1, ADD, MUL, ZERO, HSUM)                    \
+    ATTR double copy(double *a, double *, double *c, size_t n, double)                     \
+    {                                                                                      \
+        for (size_t i = 0; i < n; i += W)                                                  \
+            STORE(c + i, LOAD(a + i));                                                     \
+        return 0;                                                                          \
+    }                                                                                      \
+    ATTR double scale(double *, double *b, double *c, size_t n, double s)                  \
+    {                                                                                      \
+        V vs = SET1(s);                                                                    \
+        for (size_t i = 0; i < n; i += W)                                                  \
+            STORE(b + i, MUL(vs, LOAD(c + i)));                                            \
+        return 0;                                                                          \
+    }                                                                                      \
+    ATTR double add(double *a, double *b, double *c, size_t n, double)                     \
+    {                                                                                      \
+        for (size_t i = 0; i < n; i += W)                                                  \
+            STORE(c + i, ADD(LOAD(a + i), LOAD(b + i)));                                   \
+        return 0;                                                                          \
+    }                                                                                      \
+    ATTR double triad(double *a, double *b, double *c, size_t n, double s)                 \
+    {                                                                                      \
+        V vs = SET1(s);                                                                    \
+        for (size_t i = 0; i < n; i += W)                                                  \
+            STORE(a + i, ADD(LOAD(b + i), MUL(vs, LOAD(c + i))));                          \
+        return 0;                                                                          \
+    }                                                                                      \
+    [[maybe_unused]] ATTR double read(double *a, double *, double *, size_t n, double)     \
+    {                                                                                      \
+        V s0 = ZERO(), s1 = ZERO(), s2 = ZERO(), s3 = ZERO();                              \
+        for (size_t i = 0; i < n; i += 4 * W)                                              \
+        {                                                                                  \
+            s0 = ADD(s0, LOAD(a + i));                                                     \
+            s1 = ADD(s1, LOAD(a + i + W));                                                 \
+            s2 = ADD(s2, LOAD(a + i + 2 * W));                                             \
+            s3 = ADD(s3, LOAD(a + i + 3 * W));                                             \
+        }                                                                                  \
+        return HSUM(ADD(ADD(s0, s1), ADD(s2, s3)));                                        \
+    }                                                                                      \
+    ATTR double write(double *a, double *, double *, size_t n, double s)                   \
+    {                                                                                      \
+        V vs = SET1(s);                                                                    \
+        for (size_t i = 0; i < n; i += W)                                                  \
+            STORE(a + i, vs);                                                              \
+        return 0;                                                                          \
+    }
+
+// Plain C++, for machines without the intrinsics below (the compiler may
+// still vectorize it); it has no streaming stores
+namespace scalar
+{
+#define S_LOAD(p) (*(p))
+#define S_STORE(p, v) (*(p) = (v))
+#define S_SET1(x) (x)
+#define S_ADD(x, y) ((x) + (y))
+#define S_MUL(x, y) ((x) * (y))
+#define S_ZERO() 0.0
+#define S_HSUM(x) (x)
+    BW_KERNELS(static, double, 1, S_LOAD, S_STORE, S_SET1, S_ADD, S_MUL, S_ZERO, S_HSUM)
+}
+
+#if defined(__x86_64__)
+#define SSE2 static
+#define AVX2 __attribute__((target("avx2"))) static
+#define AVX512 __attribute__((target("avx512f"))) static
+
+SSE2 inline double hsum128(__m128d x) { return _mm_cvtsd_f64(_mm_add_pd(x, _mm_unpackhi_pd(x, x))); }
+AVX2 inline double hsum256(__m256d x) { return hsum128(_mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1))); }
+AVX512 inline double hsum512(__m512d x)
+{
+    // Through memory: the extract intrinsics trip -Wuninitialized in GCC 12
+    alignas(64) double t[8];
+    _mm512_store_pd(t, x);
+    return (t[0] + t[1]) + (t[2] + t[3]) + (t[4] + t[5]) + (t[6] + t[7]);
+}
+
+namespace sse2
+{
+    BW_KERNELS(SSE2, __m128d, 2, _mm_load_pd, _mm_store_pd, _mm_set1_pd, _mm_add_pd, _mm_mul_pd, _mm_setzero_pd, hsum128)
+}
+namespace sse2_nt
+{
+    BW_KERNELS(SSE2, __m128d, 2, _mm_load_pd, _mm_stream_pd, _mm_set1_pd, _mm_add_pd, _mm_mul_pd, _mm_setzero_pd, hsum128)
+}
+namespace avx2
+{
+    BW_KERNELS(AVX2, __m256d, 4, _mm256_load_pd, _mm256_store_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_mul_pd, _mm256_setzero_pd, hsum256)
+}
+namespace avx2_nt
+{
+    BW_KERNELS(AVX2, __m256d, 4, _mm256_load_pd, _mm256_stream_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_mul_pd, _mm256_setzero_pd, hsum256)
+}
+namespace avx512
+{
+    BW_KERNELS(AVX512, __m512d, 8, _mm512_load_pd, _mm512_store_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_mul_pd, _mm512_setzero_pd, hsum512)
+}
+namespace avx512_nt
+{
+    BW_KERNELS(AVX512, __m512d, 8, _mm512_load_pd, _mm512_stream_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_mul_pd, _mm512_setzero_pd, hsum512)
+}
+#endif
+
+struct Isa
+{
+    const char *name;
+    bool supported;
+    Kernel regular[NUM_KERNELS];
+    Kernel streaming[NUM_KERNELS]; // nullptr where there is no such variant
+};
+
+#define KERNELS(ns) {ns::copy, ns::scale, ns::add, ns::triad, ns::read, ns::write}
+#define NT_KERNELS(ns) {ns::copy, ns::scale, ns::add, ns::triad, nullptr, ns::write}
+
+std::vector<Isa> all_isas()
+{
+    std::vector<Isa> isas;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    isas.push_back({"sse2", true, KERNELS(sse2), NT_KERNELS(sse2_nt)});
+    isas.push_back({"avx2", (bool)__builtin_cpu_supports("avx2"), KERNELS(avx2), NT_KERNELS(avx2_nt)});
+    isas.push_back({"avx512", (bool)__builtin_cpu_supports("avx512f"), KERNELS(avx512), NT_KERNELS(avx512_nt)});
+#endif
+    isas.push_back({"scalar", true, KERNELS(scalar), {}});
+    return isas;
+}
+
+// Work shared between the coordinating main thread and the pinned workers.
+// For every measurement main sets the kernel, releases the workers through
+// the start barrier, and stops the clock when all have reached done.
+struct Pool
+{
+    pthread_barrier_t start, done;
+    Kernel fn{nullptr};
+    int inner{1};      // kernel calls per measurement
+    bool quit{false};
+    size_t n{0};       // elements per array per thread
+    std::vector<double *> a, b, c;
+    std::vector<int> cores;
+    double sink{0};
+};
+
+struct WorkerArg
+{
+    Pool *pool;
+    int id;
+};
+
+void *worker(void *varg)
+{
+    WorkerArg *arg = static_cast<WorkerArg *>(varg);
+    Pool &p = *arg->pool;
+    int id = arg->id;
+
+    // Allocate and first-touch this thread's arrays from its own core so that
+    // they land in its NUMA node
+    bench::pin_current_thread(p.cores[id]);
+    size_t bytes = 3 * p.n * sizeof(double);
+    void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    madvise(mem, bytes, MADV_HUGEPAGE);
+    double *base = static_cast<double *>(mem);
+    p.a[id] = base;
+    p.b[id] = base + p.n;
+    p.c[id] = base + 2 * p.n;
+    for (size_t i = 0; i < p.n; ++i) {
+        p.a[id][i] = 1.0;
+        p.b[id][i] = 2.0;
+        p.c[id][i] = 0.0;
+    }
+
+    double sum = 0;
+    for (;;) {
+        pthread_barrier_wait(&p.start);
+        if (p.quit)
+            break;
+        for (int r = 0; r < p.inner; ++r)
+            sum += p.fn(p.a[id], p.b[id], p.c[id], p.n, 3.0);
+#if defined(__x86_64__)
+        _mm_sfence(); // drain streaming stores before the clock stops
+#endif
+        pthread_barrier_wait(&p.done);
+    }
+    if (sum == 42.0) // keep the read kernel's result alive
+        p.sink = sum;
+    munmap(mem, bytes);
+    return nullptr;
+}
+
+// Runs fn once on every worker; seconds until the last is done
+double run_once(Pool &p, Kernel fn)
+{
+    p.fn = fn;
+    auto t0 = std::chrono::steady_clock::now();
+    pthread_barrier_wait(&p.start);
+    pthread_barrier_wait(&p.done);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+struct Level
+{
+    std::string name;
+    size_t bytes_per_thread;  // of all three arrays together
+};
+
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.warmup = 1;
+    opts.reps = 5;
+    opts = bench::parse_args(argc, argv, opts);
+
+    int max_threads = 0;
+    std::vector<int> cores;
+    std::string isa_filter, level_filter = "L1,L2,L3,DRAM";
+    size_t max_dram = 0;
+    const char *out_path = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:i:l:m:o:")) != -1) {
+        switch (opt) {
+        case 't': max_threads = std::atoi(optarg); break;
+        case 'c': cores = bench::parse_cpulist(optarg); break;
+        case 'i': isa_filter = optarg; break;
+        case 'l': level_filter = optarg; break;
+        case 'm': max_dram = std::strtoull(optarg, nullptr, 0); break;
+        case 'o': out_path = optarg; break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [-t max_threads] [-c cpulist] [-i sse2|avx2|avx512|scalar]"
+                         " [-l L1,L2,L3,DRAM] [-m max_dram_bytes] [-o out.csv]"
+                         " [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]" << std::endl;
+            return 1;
+        }
+    }
+
+    // --- Cores: one per physical core unless given ---
+    if (cores.empty())
+        cores = bench::usable_cores();
+    if (cores.empty())
+        cores.push_back(0);
+    if (max_threads <= 0 || max_threads > (int)cores.size())
+        max_threads = cores.size();
+
+    // Before any worker starts, so the counters follow the workers too
+    bench::Harness h("bandwidth", opts);
+
+    // --- Working sets per level ---
+    auto caches = bench::data_caches(bench::discover_caches(cores[0]));
+    size_t llc = bench::llc_size(caches);
+    std::vector<Level> levels;
+    for (size_t i = 0; i < caches.size(); ++i)
+        levels.push_back({caches[i].name().substr(0, 2), caches[i].size / 2});
+    if (max_dram == 0)
+        max_dram = 4 * llc;
+
+    FILE *out = out_path ? std::fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    bench::print_caches(caches, out);
+    std::fprintf(out, "level,threads,bytes_per_thread,isa,kernel,stores,gbps,ci_lo,ci_hi\n");
+
+    // 1, 2, 4, ... threads, and always max_threads itself
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    std::vector<Isa> isas = all_isas();
+    for (int threads : thread_counts) {
+        std::vector<Level> todo = levels;
+        for (auto &l : todo)
+            if (&l == &todo.back())    // the last level is shared by everyone
+                l.bytes_per_thread /= threads;
+        todo.push_back({"DRAM", max_dram / threads});
+
+        for (const Level &level : todo) {
+            if (level_filter.find(level.name) == std::string::npos)
+                continue;
+
+            // --- Start a pool pinned to the first threads cores ---
+            Pool pool;
+            pool.n = std::max<size_t>(64, level.bytes_per_thread / (3 * sizeof(double)) / 64 * 64);
+            pool.a.resize(threads);
+            pool.b.resize(threads);
+            pool.c.resize(threads);
+            pool.cores.assign(cores.begin(), cores.begin() + threads);
+            // Move at least ~256 MB per measurement, so barriers are noise
+            pool.inner = std::max<size_t>(1, (256u << 20) / (24 * pool.n * threads));
+            pthread_barrier_init(&pool.start, nullptr, threads + 1);
+            pthread_barrier_init(&pool.done, nullptr, threads + 1);
+            std::vector<pthread_t> tids(threads);
+            std::vector<WorkerArg> args(threads);
+            for (int t = 0; t < threads; ++t) {
+                args[t] = {&pool, t};
+                pthread_create(&tids[t], nullptr, worker, &args[t]);
+            }
+
+            for (const Isa &isa : isas) {
+                if (!isa.supported || (!isa_filter.empty() && isa_filter != isa.name))
+                    continue;
+                for (int k = 0; k < NUM_KERNELS; ++k) {
+                    for (int nt = 0; nt < 2; ++nt) {
+                        Kernel fn = nt ? isa.streaming[k] : isa.regular[k];
+                        if (!fn)
+                            continue;
+                        double bytes = double(kernel_info[k].bytes_per_elem) * pool.n * threads * pool.inner;
+                        std::string name = level.name + "/" + std::to_string(threads) + "/" + isa.name +
+                                           "/" + kernel_info[k].name + (nt ? "/nt" : "");
+                        // Counters per cache line moved
+                        const bench::Stats &s = h.per(bytes / 64).measure(name, "GB/s", [&] {
+                            return bytes / run_once(pool, fn) / 1e9;
+                        });
+                        std::fprintf(out, "%s,%d,%zu,%s,%s,%s,%.2f,%.2f,%.2f\n", level.name.c_str(), threads,
+                                     3 * pool.n * sizeof(double), isa.name, kernel_info[k].name,
+                                     nt ? "nt" : "regular", s.median, s.ci_lo, s.ci_hi);
+                        std::fflush(out);
+                    }
+                }
+            }
+
+            pool.quit = true;
+            pthread_barrier_wait(&pool.start);
+            for (pthread_t t : tids)
+                pthread_join(t, nullptr);
+            pthread_barrier_destroy(&pool.start);
+            pthread_barrier_destroy(&pool.done);
+        }
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    h.finish();
+    return 0;
+}
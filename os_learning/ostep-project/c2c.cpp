@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "include/affinity.h"
+#include "include/bench.h"
+
+// Core-to-core latency: for every pair of cores, two pinned threads bounce a
+// cache line back and forth, and the one-way time is half a round trip. The
+// matrix shows where the line has to travel: SMT siblings share an L1, cores
+// of a cluster or CCX share an L3, and crossing a socket goes over the
+// interconnect. Variants:
+//   shared  one line; each side waits for the other's value, then stores
+//   cas     one line; each side compare-and-swaps it from the other's value
+//   xchg    one line; each side waits for the other's value, then exchanges
+//   split   two lines, each written by one side and read by the other
+// Then false sharing: both threads increment their own counter, once with the
+// counters in one line and once 128 bytes apart, and the matrix is the ratio
+// of time per increment. Writes one N x N CSV block per variant. Each pair
+// runs under the include/bench.h harness and the matrix has its median;
+// --json has the confidence intervals.
+//
+// usage: c2c [-c cpulist] [-v shared,cas,xchg,split,false] [-n rounds] [-o out.csv]
+//            [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]
+
+static inline void cpu_relax() {
+#if defined(__x86_64__)
+    _mm_pause();
+#endif
+}
+
+// 128 bytes rather than 64: Intel's spatial prefetcher fetches lines in
+// pairs, which would drag a neighbour into the ping-pong
+struct alignas(128) Line
+{
+    std::atomic<uint64_t> v{0};
+};
+
+// Starts a on core ca and b on core cb together and returns a's result
+template <typename A, typename B>
+double run_pair(int ca, int cb, A a, B b) {
+    std::atomic<int> ready{0};
+    double result = 0;
+    auto start = [&ready](int core) {
+        bench::pin_current_thread(core);
+        ready.fetch_add(1);
+        while (ready.load() < 2)
+            cpu_relax();
+    };
+    std::thread tb([&] { start(cb); b(); });
+    std::thread ta([&] { start(ca); result = a(); });
+    ta.join();
+    tb.join();
+    return result;
+}
+
+using Clock = std::chrono::steady_clock;
+
+double ns_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+}
+
+// One-way ns for a cache line handed back and forth rounds times
+double ping_pong(const std::string &variant, int ca, int cb, long rounds) {
+    Line ping, pong;
+    std::atomic<uint64_t> &f = ping.v;
+    if (variant == "shared") {
+        return run_pair(ca, cb,
+            [&] {
+                auto t0 = Clock::now();
+                for (uint64_t r = 0; r < (uint64_t)rounds; ++r) {
+                    while (f.load(std::memory_order_acquire) != 2 * r)
+                        cpu_relax();
+                    f.store(2 * r + 1, std::memory_order_release);
+                }
+                return ns_since(t0) / (2 * rounds);
+            },
+            [&] {
+                for (uint64_t r = 0; r < (uint64_t)rounds; ++r) {
+                    while (f.load(std::memory_order_acquire) != 2 * r + 1)
+                        cpu_relax();
+                    f.store(2 * r + 2, std::memory_order_release);
+                }
+            });
+    }
+    if (variant == "cas") {
+        auto step = [&f](uint64_t from) {
+            uint64_t expected = from;
+            while (!f.compare_exchange_weak(expected, from + 1, std::memory_order_acq_rel)) {
+                expected = from;
+                cpu_relax();
+            }
+        };
+        return run_pair(ca, cb,
+            [&] {
+                auto t0 = Clock::now();
+                for (uint64_t r = 0; r < (uint64_t)rounds; ++r)
+                    step(2 * r);
+                return ns_since(t0) / (2 * rounds);
+            },
+            [&] {
+                for (uint64_t r = 0; r < (uint64_t)rounds; ++r)
+                    step(2 * r + 1);
+            });
+    }
+    if (variant == "xchg") {
+        // Like shared, but the hand-off is a locked read-modify-write
+        auto step = [&f](uint64_t from) {
+            while (f.load(std::memory_order_acquire) != from)
+                cpu_relax();
+            f.exchange(from + 1, std::memory_order_acq_rel);
+        };
+        return run_pair(ca, cb,
+            [&] {
+                auto t0 = Clock::now();
+                for (uint64_t r = 0; r < (uint64_t)rounds; ++r)
+                    step(2 * r);
+                return ns_since(t0) / (2 * rounds);
+            },
+            [&] {
+                for (uint64_t r = 0; r < (uint64_t)rounds; ++r)
+                    step(2 * r + 1);
+            });
+    }
+    // split: a writes ping and reads pong, b the other way round
+    std::atomic<uint64_t> &g = pong.v;
+    return run_pair(ca, cb,
+        [&] {
+            auto t0 = Clock::now();
+            for (uint64_t r = 1; r <= (uint64_t)rounds; ++r) {
+                f.store(r, std::memory_order_release);
+                while (g.load(std::memory_order_acquire) != r)
+                    cpu_relax();
+            }
+            return ns_since(t0) / (2 * rounds);
+        },
+        [&] {
+            for (uint64_t r = 1; r <= (uint64_t)rounds; ++r) {
+                while (f.load(std::memory_order_acquire) != r)
+                    cpu_relax();
+                g.store(r, std::memory_order_release);
+            }
+        });
+}
+
+// Slowdown of two threads incrementing neighbouring counters in one line
+// over the same with the counters on separate lines
+double false_sharing(int ca, int cb, long iters) {
+    struct alignas(128) Same { volatile uint64_t a, b; };
+    struct Padded { alignas(128) volatile uint64_t a; alignas(128) volatile uint64_t b; };
+    auto bump = [iters](volatile uint64_t &x) {
+        auto t0 = Clock::now();
+        for (long i = 0; i < iters; ++i)
+            x = x + 1;
+        return ns_since(t0) / iters;
+    };
+    Same same{};
+    Padded padded{};
+    double same_ns = run_pair(ca, cb, [&] { return bump(same.a); }, [&] { bump(same.b); });
+    double padded_ns = run_pair(ca, cb, [&] { return bump(padded.a); }, [&] { bump(padded.b); });
+    return same_ns / padded_ns;
+}
+
+void print_matrix(FILE *out, const char *title, const std::vector<int> &cores,
+                  const std::vector<std::vector<double>> &m) {
+    std::fprintf(out, "# %s\ncpu", title);
+    for (int c : cores)
+        std::fprintf(out, ",%d", c);
+    std::fprintf(out, "\n");
+    for (size_t i = 0; i < cores.size(); ++i) {
+        std::fprintf(out, "%d", cores[i]);
+        for (size_t j = 0; j < cores.size(); ++j) {
+            if (i == j)
+                std::fprintf(out, ",");
+            else
+                std::fprintf(out, ",%.1f", m[i][j]);
+        }
+        std::fprintf(out, "\n");
+    }
+
+    // Range, so the boundaries stand out without plotting
+    std::vector<double> all;
+    for (size_t i = 0; i < cores.size(); ++i)
+        for (size_t j = 0; j < cores.size(); ++j)
+            if (i != j)
+                all.push_back(m[i][j]);
+    if (!all.empty()) {
+        std::sort(all.begin(), all.end());
+        std::fprintf(out, "# min %.1f  median %.1f  max %.1f\n\n",
+                     all.front(), all[all.size() / 2], all.back());
+    }
+    std::fflush(out);
+}
+
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.warmup = 1;
+    opts.reps = 5;
+    opts = bench::parse_args(argc, argv, opts);
+
+    std::vector<int> cores;
+    std::string variants = "shared,cas,xchg,split,false";
+    long rounds = 20000;
+    const char *out_path = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:v:n:o:")) != -1) {
+        switch (opt) {
+        case 'c': cores = bench::parse_cpulist(optarg); break;
+        case 'v': variants = optarg; break;
+        case 'n': rounds = std::max(1L, std::atol(optarg)); break;
+        case 'o': out_path = optarg; break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [-c cpulist] [-v shared,cas,xchg,split,false] [-n rounds] [-o out.csv]"
+                         " [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Every hardware thread, SMT siblings included: they are the pairs with
+    // the cheapest hand-off
+    if (cores.empty())
+        cores = bench::usable_cores(false);
+    if (cores.size() < 2) {
+        std::cerr << "c2c: need at least two cores (have " << cores.size() << ")" << std::endl;
+        return 1;
+    }
+
+    // The pairs pin themselves; the harness only checks the first core's clock
+    opts.cpu = -1;
+    bench::Harness h("c2c", opts);
+
+    FILE *out = out_path ? std::fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    const size_t n = cores.size();
+    for (const char *v : {"shared", "cas", "xchg", "split", "false"}) {
+        if (variants.find(v) == std::string::npos)
+            continue;
+        std::vector<std::vector<double>> m(n, std::vector<double>(n, 0));
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i + 1; j < n; ++j) {
+                // The pair is symmetric, so measure it once
+                std::string name = std::string(v) + "/" + std::to_string(cores[i]) + "-" +
+                                   std::to_string(cores[j]);
+                const bench::Stats &s = std::string(v) == "false"
+                    ? h.measure(name, "ratio", [&] { return false_sharing(cores[i], cores[j], 50 * rounds); })
+                    : h.per(2.0 * rounds).measure(name, "ns", [&] { return ping_pong(v, cores[i], cores[j], rounds); });
+                m[i][j] = m[j][i] = s.median;
+            }
+        }
+        if (std::string(v) == "false")
+            print_matrix(out, "false sharing: same-line / separate-line time per increment", cores, m);
+        else
+            print_matrix(out, (std::string(v) + ": one-way ns").c_str(), cores, m);
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    h.finish();
+    return 0;
+}
@@ -2,104 +2,129 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
-#include <numeric>
 #include <algorithm>
-#include <sched.h>
-#include <pthread.h> 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 
-void consume_value(volatile long long& val) {
-    // This function does nothing, but ensures 'val' is used
-    // and prevents compiler from optimizing away the access
-}
-
-int main() {
-    const size_t L1_SIZE_BYTES = 32 * 1024;  // e.g., 32KB
-    const size_t L2_SIZE_BYTES = 256 * 1024; // e.g., 256KB
-    const size_t L3_SIZE_BYTES = 6 * 1024 * 1024; // e.g., 8MB
-    const size_t CACHE_LINE_SIZE = 64; // Typical for x86
-
-    const size_t TEST_SIZE_L1_HIT = L1_SIZE_BYTES / sizeof(long long);
-    const size_t TEST_SIZE_L2_HIT = L2_SIZE_BYTES / sizeof(long long);
-    const size_t TEST_SIZE_L3_HIT = L3_SIZE_BYTES / sizeof(long long);
-    const size_t TEST_SIZE_RAM = L3_SIZE_BYTES * 2 / sizeof(long long);
+#include "include/affinity.h"
+#include "include/cache_info.h"
+#include "include/bench.h"
+#include "include/chase.h"
+#include "include/numa.h"
 
-    std::vector<long long> data_l1(TEST_SIZE_L1_HIT);
-    std::vector<long long> data_l2(TEST_SIZE_L2_HIT);
-    std::vector<long long> data_l3(TEST_SIZE_L3_HIT);
-    std::vector<long long> data_ram(TEST_SIZE_RAM);
+// Sweeps the working-set size on a log scale from 4 KiB to 4x the last-level
+// cache and measures the load-to-use latency at each size with a dependent
+// random pointer chase (include/chase.h). Each node fills one cache line and
+// the chase visits every node once per lap in a random order, so neither the
+// prefetcher nor a short cycle can hide a miss. With -P the lines of each
+// page are visited together, which takes TLB misses out of the curve. With
+// -N the buffer is bound to that NUMA node instead of wherever first touch
+// puts it; run on a core of another node (-c) to see the remote curve, or
+// use numa.cpp for the whole node x node matrix.
+// Each point runs under the include/bench.h harness; the CSV has the median,
+// its 95% confidence interval, and per-load hardware counts that show which
+// level the loads really missed in (empty where perf_event is unavailable):
+//   bytes,kib,level,ns_per_load,ci_lo,ci_hi,cycles,instructions,l1d_miss,
+//   llc_miss,dtlb_miss,branch_miss
+//
+// usage: cache [-c core] [-p points_per_octave] [-m max_bytes] [-n loads] [-P] [-N node] [-o out.csv]
+//              [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]
 
-    std::iota(data_l1.begin(), data_l1.end(), 0);
-    std::iota(data_l2.begin(), data_l2.end(), 0);
-    std::iota(data_l3.begin(), data_l3.end(), 0);
-    std::iota(data_ram.begin(), data_ram.end(), 0);
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.warmup = 1;
+    opts.reps = 5;
+    opts = bench::parse_args(argc, argv, opts);
 
-    // --- CPU Pinning ---
-    int core_to_pin = 0; // Pin to CPU core 0 (or choose another)
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(core_to_pin, &cpuset);
-
-    // Pin the current process (or just the main thread)
-    // For a multi-threaded application, you'd call this for each relevant pthread.
-    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
-        std::cerr << "Warning: Could not set CPU affinity to core " << core_to_pin << std::endl;
-        perror("pthread_setaffinity_np");
-    } else {
-        std::cout << "Successfully pinned process to core " << core_to_pin << std::endl;
-    }
+    int core_to_pin = 0;          // Pin to CPU core 0 (or choose another with -c)
+    int points_per_octave = 4;
+    size_t max_bytes = 0;         // 0 -> 4x the last-level cache
+    long long loads = 1LL << 22;
+    const char *out_path = nullptr;
+    bench::ChaseOrder order = bench::ChaseOrder::Random;
+    int mem_node = -1;            // -1: first touch
 
-    // ... Test L1 Hit Latency ...
-    long long dummy_sum_l1 = 0;
-    const int REPEAT_L1 = 10000;
-    auto start_l1 = std::chrono::high_resolution_clock::now();
-    for (int r = 0; r < REPEAT_L1; ++r) {
-        for (size_t i = 0; i < TEST_SIZE_L1_HIT; ++i) {
-            dummy_sum_l1 += data_l1[i];
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:m:n:o:PN:")) != -1) {
+        switch (opt) {
+        case 'c': core_to_pin = std::atoi(optarg); break;
+        case 'p': points_per_octave = std::max(1, std::atoi(optarg)); break;
+        case 'm': max_bytes = std::strtoull(optarg, nullptr, 0); break;
+        case 'n': loads = std::max(8LL, std::atoll(optarg)); break;
+        case 'o': out_path = optarg; break;
+        case 'P': order = bench::ChaseOrder::PageLocal; break;
+        case 'N': mem_node = std::atoi(optarg); break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [-c core] [-p points_per_octave] [-m max_bytes] [-n loads] [-P] [-N node] [-o out.csv]"
+                         " [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]" << std::endl;
+            return 1;
         }
     }
-    auto end_l1 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_l1 = end_l1 - start_l1;
-    std::cout << "L1 Hit Latency (per long long): " << duration_l1.count() / (TEST_SIZE_L1_HIT * REPEAT_L1) << " ns" << std::endl;
 
-    // Repeat for L2, L3, RAM tests
-    long long dummy_sum_l2 = 0;
-    const size_t L1_STRIDE_ELEMENTS = CACHE_LINE_SIZE / sizeof(long long);
-    const int REPEAT_L2 = 1000;
-    auto start_l2 = std::chrono::high_resolution_clock::now();
-    for (int r = 0; r < REPEAT_L2; ++r) {
-        for (size_t i = 0; i < TEST_SIZE_L2_HIT; i += L1_STRIDE_ELEMENTS) {
-            dummy_sum_l2 += data_l2[i];
-        }
+    // --- CPU Pinning (done by the harness) ---
+    opts.cpu = core_to_pin;
+    bench::Harness h("cache", opts);
+
+    // --- Cache topology ---
+    auto caches = bench::discover_caches(core_to_pin);
+    const size_t line = bench::line_size(caches);
+    if (max_bytes == 0)
+        max_bytes = 4 * bench::llc_size(caches);
+
+    FILE *out = out_path ? std::fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
     }
-    auto end_l2 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_l2 = end_l2 - start_l2;
-    std::cout << "L2 Hit Latency (per long long, L1 miss): " << duration_l2.count() / (TEST_SIZE_L2_HIT / L1_STRIDE_ELEMENTS * REPEAT_L2) << " ns" << std::endl;
+    if (caches.empty())
+        std::fprintf(out, "# cache topology unknown; labels assume no caches\n");
+    bench::print_caches(caches, out);
+    std::fprintf(out, "bytes,kib,level,ns_per_load,ci_lo,ci_hi");
+    for (const bench::PerfEvent &e : bench::default_events())
+        std::fprintf(out, ",%s", e.name);
+    std::fprintf(out, "\n");
 
-    long long dummy_sum_l3 = 0;
-    const size_t L2_STRIDE_ELEMENTS = (L2_SIZE_BYTES + CACHE_LINE_SIZE) / sizeof(long long);
-    const int REPEAT_L3 = 100;
-    auto start_l3 = std::chrono::high_resolution_clock::now();
-    for (int r = 0; r < REPEAT_L3; ++r) {
-        for (size_t i = 0; i < TEST_SIZE_L3_HIT; i += L2_STRIDE_ELEMENTS) {
-            dummy_sum_l3 += data_l3[i];
-        }
+    // --- Sweep ---
+    bench::Chase chase(max_bytes);
+    if (mem_node >= 0) {
+        if (!bench::bind_memory(chase.base(), chase.capacity(), mem_node))
+            return 1;
+        std::fprintf(out, "# memory bound to node %d, running on core %d\n", mem_node, core_to_pin);
     }
-    auto end_l3 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_l3 = end_l3 - start_l3;
-    std::cout << "L3 Hit Latency (per long long, L2 miss): " << duration_l3.count() / (TEST_SIZE_L3_HIT / L2_STRIDE_ELEMENTS * REPEAT_L3) << " ns" << std::endl;
+    const size_t min_bytes = 4096;
+    size_t last = 0;
+    for (int k = 0;; ++k) {
+        size_t bytes = static_cast<size_t>(min_bytes * std::pow(2.0, double(k) / points_per_octave));
+        bytes = bytes / line * line;
+        if (bytes > max_bytes)
+            break;
+        if (bytes == last)
+            continue;
+        last = bytes;
 
-    long long dummy_sum_ram = 0;
-    const size_t L3_STRIDE_ELEMENTS = (L3_SIZE_BYTES + CACHE_LINE_SIZE) / sizeof(long long);
-    const int REPEAT_RAM = 10;
-    auto start_ram = std::chrono::high_resolution_clock::now();
-    for (int r = 0; r < REPEAT_RAM; ++r) {
-        for (size_t i = 0; i < TEST_SIZE_RAM; i += L3_STRIDE_ELEMENTS) {
-            dummy_sum_ram += data_ram[i];
+        chase.link(bytes, line, order);
+        long long n = std::max<long long>(loads, chase.nodes());
+        const bench::Stats &s = h.per(n).measure(std::to_string(bytes), "ns",
+                                                 [&] { return chase.ns_per_load(n, 1, false); });
+        std::fprintf(out, "%zu,%.1f,%s,%.3f,%.3f,%.3f", bytes, bytes / 1024.0,
+                     bench::level_for(caches, bytes).c_str(), s.median, s.ci_lo, s.ci_hi);
+        for (const bench::PerfEvent &e : bench::default_events()) {
+            auto c = std::find_if(s.counters.begin(), s.counters.end(),
+                                  [&](const auto &kv) { return kv.first == e.name; });
+            if (c == s.counters.end() || std::isnan(c->second))
+                std::fprintf(out, ",");
+            else
+                std::fprintf(out, ",%.3f", c->second);
         }
+        std::fprintf(out, "\n");
+        std::fflush(out);
     }
-    auto end_ram = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_ram = end_ram - start_ram;
-    std::cout << "RAM Latency (per long long, L3 miss): " << duration_ram.count() / (TEST_SIZE_RAM / L3_STRIDE_ELEMENTS * REPEAT_RAM) << " ns" << std::endl;
 
+    if (out != stdout)
+        std::fclose(out);
+    h.finish();
     return 0;
-}
\ No newline at end of file
+}
@@ -1,162 +1,141 @@
-#define _GNU_SOURCE 
+#define _GNU_SOURCE
 #include <iostream>
 #include <vector>
-#include <chrono>
-#include <numeric>
 #include <algorithm>
-#include <random> 
-#include <sched.h>   
-#include <pthread.h>  
-#include <unistd.h>   
-#include <thread>
-
-const size_t CACHE_LINE_SIZE = 64; // Common for x86 CPUs
-const size_t INT_SIZE_BYTES = sizeof(int);
-// Helper function to prevent compiler optimizations
-void consume_value(volatile int& val) {
-    // This function does nothing, but ensures 'val' is used
-    // and prevents compiler from optimizing away the access
-}
-
-// Function to fill array with shuffled indices for pointer chasing
-void fill_random_indices(std::vector<int>& arr) {
-    std::iota(arr.begin(), arr.end(), 0);
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(arr.begin(), arr.end(), g);
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "include/affinity.h"
+#include "include/cache_info.h"
+#include "include/bench.h"
+#include "include/chase.h"
+
+// Pointer-chasing latency of each level of the memory hierarchy. Each test
+// builds a single random cycle (Sattolo) over cache-line-sized nodes that
+// fill ~80% of the level, so every load misses the level above and the
+// chase cannot get stuck in a short loop; see include/chase.h. A chase only
+// has one load in flight, so it says nothing about bandwidth; bandwidth.cpp
+// measures that. Each test runs under the include/bench.h harness and
+// reports the median with a 95% confidence interval, plus hardware counts per
+// load where perf_event allows (an L2 test should show ~1 L1D miss and no
+// LLC misses per load); --json=FILE saves them.
+//
+// With -M, the L2, L3 and RAM tests also run K = 1..32 independent chains
+// interleaved in one loop, the way a batch of hash-table probes keeps several
+// misses in flight. It prints the effective ns per access for each K and the
+// saturation point: the fewest chains that reach 90% of the best throughput,
+// which is about how many misses the core and memory system can overlap.
+//
+// usage: cachePointer [-P] [-M] [-k max_chains] [--cpu=N] [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]
+//   -P: visit each page's lines together, to keep TLB misses out of the numbers
+
+// Chases a chain over bytes of memory and reports its latency. The caches
+// are flushed once so the test starts cold; the harness's warm-up runs then
+// bring the chain into the level under test.
+void run_test(bench::Harness &h, const std::string &label, size_t bytes, long long accesses,
+              size_t line, bench::ChaseOrder order, bench::CacheFlusher &flush_caches) {
+    bench::Chase chase(bytes);
+    chase.link(bytes, line, order);
+
+    flush_caches();
+    accesses = std::max<long long>(accesses, chase.nodes());
+    const bench::Stats &s = h.per(accesses).measure(label, "ns", [&] {
+        return chase.ns_per_load(accesses, 1, false);
+    });
+    std::cout << label << " Latency (pointer chase, " << (bytes >> 10) << " KiB, "
+              << chase.nodes() << " lines): " << s.median << " ns  [95% CI " << s.ci_lo << ", "
+              << s.ci_hi << "]" << std::endl;
+    bench::Harness::print_counters(stdout, s, "  per load:");
+    std::fflush(stdout);
 }
 
-// Function to flush caches between tests (best effort, not guaranteed)
-void flush_caches(size_t ram_size_bytes) {
-    std::vector<char> large_array(ram_size_bytes, 0); // Initialize to ensure pages are allocated
-
-    for (size_t i = 0; i < large_array.size(); i += CACHE_LINE_SIZE) {
-        large_array[i] = (char)(i % 256);
+// Chases 1..max_chains independent chains at once over bytes of memory
+void run_mlp_test(const std::string &label, size_t bytes, long long accesses, size_t line,
+                  bench::ChaseOrder order, bench::CacheFlusher &flush_caches, int max_chains) {
+    bench::Chase chase(bytes);
+    chase.link(bytes, line, order);
+
+    flush_caches();
+    std::cout << label << " MLP (" << (bytes >> 10) << " KiB):" << std::endl;
+    std::cout << "  chains  ns/access  speedup" << std::endl;
+    std::vector<double> ns(max_chains + 1);
+    int best = 1;
+    for (int k = 1; k <= max_chains; ++k) {
+        ns[k] = chase.ns_per_load_parallel(accesses, k);
+        if (ns[k] < ns[best])
+            best = k;
+        std::printf("  %6d  %9.2f  %6.2fx\n", k, ns[k], ns[1] / ns[k]);
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    int saturation = 1;
+    while (ns[best] / ns[saturation] < 0.9)
+        ++saturation;
+    std::printf("  saturates at ~%d chains (%.1fx; best %.1fx at %d chains)\n",
+                saturation, ns[1] / ns[saturation], ns[1] / ns[best], best);
+    std::fflush(stdout);
 }
 
-
-int main() {
-    // --- CPU Pinning ---
-    const int core_to_pin = 0;
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(core_to_pin, &cpuset);
-
-    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
-        std::cerr << "Warning: Could not set CPU affinity to core " << core_to_pin << std::endl;
-        perror("pthread_setaffinity_np");
-    } else {
-        std::cout << "Successfully pinned process to core " << core_to_pin << std::endl;
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.reps = 7;
+    opts.cpu = 0;                 // Pin to CPU core 0 (or choose another with --cpu)
+    bench::Harness h("cachePointer", bench::parse_args(argc, argv, opts));
+
+    bench::ChaseOrder order = bench::ChaseOrder::Random;
+    bool mlp = false;
+    int max_chains = bench::max_parallel_chains;
+    int opt;
+    while ((opt = getopt(argc, argv, "PMk:")) != -1) {
+        switch (opt) {
+        case 'P': order = bench::ChaseOrder::PageLocal; break;
+        case 'M': mlp = true; break;
+        case 'k': max_chains = std::clamp(std::atoi(optarg), 1, bench::max_parallel_chains); break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [-P] [-M] [-k max_chains] [--cpu=N] [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]"
+                      << std::endl;
+            return 1;
+        }
     }
 
-    // --- Cache Size Estimates
-    const size_t L1_D_CACHE_SIZE_BYTES = 32 * 1024;  // L1 Data Cache
-    const size_t L2_CACHE_SIZE_BYTES   = 256 * 1024; // L2 Unified Cache (per core)
-    const size_t L3_CACHE_SIZE_BYTES   = 6 * 1024 * 1024; // L3 Shared Cache (for i7-8550U)
-
+    // --- Cache Sizes, from sysfs or cpuid (falling back to an i7-8550U) ---
+    auto caches = bench::data_caches(bench::discover_caches(h.options().cpu));
+    auto level_size = [&](size_t i, size_t fallback) {
+        return i < caches.size() ? caches[i].size : fallback;
+    };
+    const size_t L1_D_CACHE_SIZE_BYTES = level_size(0, 32 * 1024);        // L1 Data Cache
+    const size_t L2_CACHE_SIZE_BYTES   = level_size(1, 256 * 1024);       // L2 Unified Cache (per core)
+    const size_t L3_CACHE_SIZE_BYTES   = level_size(2, 6 * 1024 * 1024);  // L3 Shared Cache
+    const size_t LINE_SIZE             = bench::line_size(caches);
+    bench::print_caches(caches);
 
     // --- Test Parameters ---
     const long long NUM_ACCESSES_L1  = 50000000;
     const long long NUM_ACCESSES_L2  = 20000000;
     const long long NUM_ACCESSES_L3  = 5000000;
-    const long long NUM_ACCESSES_RAM = 1000000;  
+    const long long NUM_ACCESSES_RAM = 1000000;
 
-    // Array sizes for pointer chasing. Elements are 'int' (4 bytes).
-    // Ensure array is slightly *smaller* than the cache level to guarantee hits.
-    // Use prime numbers or sizes that are not powers of 2 for better cache distribution
-    // within sets if associativity is a concern.
-    const size_t L1_ARRAY_ELEMENTS = (L1_D_CACHE_SIZE_BYTES / INT_SIZE_BYTES) * 0.8; // ~80% of L1
-    const size_t L2_ARRAY_ELEMENTS = (L2_CACHE_SIZE_BYTES / INT_SIZE_BYTES) * 0.8;   // ~80% of L2
-    const size_t L3_ARRAY_ELEMENTS = (L3_CACHE_SIZE_BYTES / INT_SIZE_BYTES) * 0.8;   // ~80% of L3
-    const size_t RAM_ARRAY_ELEMENTS = (L3_CACHE_SIZE_BYTES * 2 / INT_SIZE_BYTES);   // Larger than L3
-
-    // Vectors to hold the "pointer chasing" indices
-    std::vector<int> data_l1(L1_ARRAY_ELEMENTS);
-    std::vector<int> data_l2(L2_ARRAY_ELEMENTS);
-    std::vector<int> data_l3(L3_ARRAY_ELEMENTS);
-    std::vector<int> data_ram(RAM_ARRAY_ELEMENTS);
-
-    
-    fill_random_indices(data_l1);
-    fill_random_indices(data_l2);
-    fill_random_indices(data_l3);
-    fill_random_indices(data_ram);
-
-    int current_index = 0; 
+    // Working sets fill ~80% of each level so that they stay resident, and
+    // the RAM test is well past the last level.
+    const size_t L1_BYTES  = L1_D_CACHE_SIZE_BYTES * 8 / 10;
+    const size_t L2_BYTES  = L2_CACHE_SIZE_BYTES * 8 / 10;
+    const size_t L3_BYTES  = L3_CACHE_SIZE_BYTES * 8 / 10;
+    const size_t RAM_BYTES = L3_CACHE_SIZE_BYTES * 4;
+    bench::CacheFlusher flush(L3_CACHE_SIZE_BYTES * 2);
 
     // --- Run Tests ---
-    const double BYTES_TO_GB = 1.0 / (1024.0 * 1024.0 * 1024.0);
-
-    // 1. L1 Hit Latency & Throughput
-    flush_caches(L3_CACHE_SIZE_BYTES * 2);
-    current_index = 0;
-    auto start_l1 = std::chrono::high_resolution_clock::now();
-
-    for (long long i = 0; i < NUM_ACCESSES_L1; ++i) {
-        current_index = data_l1[current_index % L1_ARRAY_ELEMENTS]; // Use modulo for safety/wrap-around
-    }
-
-    auto end_l1 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_l1 = end_l1 - start_l1;
-    double l1_latency_ns = duration_l1.count() / NUM_ACCESSES_L1;
-    // ns to s, then convert bytes to GB
-    double l1_throughput_gbps = (NUM_ACCESSES_L1 * INT_SIZE_BYTES) / duration_l1.count() * 1000.0;
-    std::cout << "L1 Hit Latency (per int, pointer chase): " << l1_latency_ns << " ns" << std::endl;
-    std::cout << "L1 Throughput: " << l1_throughput_gbps << " GB/s" << std::endl;
-    consume_value(current_index);
-
-    // 2. L2 Hit Latency & Throughput
-    flush_caches(L3_CACHE_SIZE_BYTES * 2);
-    current_index = 0;
-    auto start_l2 = std::chrono::high_resolution_clock::now();
-
-    for (long long i = 0; i < NUM_ACCESSES_L2; ++i) {
-        current_index = data_l2[current_index % L2_ARRAY_ELEMENTS];
-    }
-
-    auto end_l2 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_l2 = end_l2 - start_l2;
-    double l2_latency_ns = duration_l2.count() / NUM_ACCESSES_L2;
-    double l2_throughput_gbps = (NUM_ACCESSES_L2 * INT_SIZE_BYTES) / duration_l2.count() * 1000.0;
-    std::cout << "L2 Hit Latency (per int, pointer chase): " << l2_latency_ns << " ns" << std::endl;
-    std::cout << "L2 Throughput: " << l2_throughput_gbps << " GB/s" << std::endl;
-    consume_value(current_index);
-
-    // 3. L3 Hit Latency & Throughput
-    flush_caches(L3_CACHE_SIZE_BYTES * 2);
-    current_index = 0;
-    auto start_l3 = std::chrono::high_resolution_clock::now();
-
-    for (long long i = 0; i < NUM_ACCESSES_L3; ++i) {
-        current_index = data_l3[current_index % L3_ARRAY_ELEMENTS];
+    run_test(h, "L1 Hit", L1_BYTES, NUM_ACCESSES_L1, LINE_SIZE, order, flush);
+    run_test(h, "L2 Hit", L2_BYTES, NUM_ACCESSES_L2, LINE_SIZE, order, flush);
+    run_test(h, "L3 Hit", L3_BYTES, NUM_ACCESSES_L3, LINE_SIZE, order, flush);
+    run_test(h, "RAM", RAM_BYTES, NUM_ACCESSES_RAM, LINE_SIZE, order, flush);
+
+    if (mlp) {
+        run_mlp_test("L2", L2_BYTES, NUM_ACCESSES_L2, LINE_SIZE, order, flush, max_chains);
+        run_mlp_test("L3", L3_BYTES, NUM_ACCESSES_L3, LINE_SIZE, order, flush, max_chains);
+        run_mlp_test("RAM", RAM_BYTES, NUM_ACCESSES_RAM, LINE_SIZE, order, flush, max_chains);
     }
 
-    auto end_l3 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_l3 = end_l3 - start_l3;
-    double l3_latency_ns = duration_l3.count() / NUM_ACCESSES_L3;
-    double l3_throughput_gbps = (NUM_ACCESSES_L3 * INT_SIZE_BYTES) / duration_l3.count() * 1000.0;
-    std::cout << "L3 Hit Latency (per int, pointer chase): " << l3_latency_ns << " ns" << std::endl;
-    std::cout << "L3 Throughput: " << l3_throughput_gbps << " GB/s" << std::endl;
-    consume_value(current_index);
-
-    // 4. RAM Latency & Throughput
-    flush_caches(L3_CACHE_SIZE_BYTES * 2);
-    current_index = 0;
-    auto start_ram = std::chrono::high_resolution_clock::now();
-
-    for (long long i = 0; i < NUM_ACCESSES_RAM; ++i) {
-        current_index = data_ram[current_index % RAM_ARRAY_ELEMENTS];
-    }
-
-    auto end_ram = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::nano> duration_ram = end_ram - start_ram;
-    double ram_latency_ns = duration_ram.count() / NUM_ACCESSES_RAM;
-    double ram_throughput_gbps = (NUM_ACCESSES_RAM * INT_SIZE_BYTES) / duration_ram.count() * 1000.0;
-    std::cout << "RAM Latency (per int, pointer chase): " << ram_latency_ns << " ns" << std::endl;
-    std::cout << "RAM Throughput: " << ram_throughput_gbps << " GB/s" << std::endl;
-    consume_value(current_index);
-
+    h.finish();
     return 0;
-}
\ No newline at end of file
+}
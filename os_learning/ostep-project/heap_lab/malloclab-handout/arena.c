@@ -0,0 +1,121 @@
+/*
+ * arena.c - A bump-pointer region malloc package, built as an mdriver
+ *           backend (make arena.so; mdriver -b arena.so).
+ *
+ * malloc carves the next block off the end of the region and free only
+ * counts live blocks. When the count drops to zero the region is empty,
+ * so the bump pointer goes back to the start and the pages behind it
+ * are handed back with mem_decommit. realloc grows the most recent
+ * block in place. This is about as fast as an allocator gets, and on a
+ * trace whose live set never drains it is also the least frugal.
+ *
+ * Every block starts with a one-word header that holds its capacity.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define ALIGNMENT   8
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+#define HDRSIZE     ALIGN(sizeof(size_t))  /* block header */
+#define ARENA_CHUNK (1 << 16)              /* least heap taken per sbrk */
+
+#define CAP(bp) (*(size_t *)((char *)(bp) - HDRSIZE))
+
+static char *arena_lo;  /* start of the region */
+static char *bump;      /* first unused byte */
+static char *arena_hi;  /* end of the heap we own */
+static char *last;      /* most recently allocated block */
+static long live;       /* blocks allocated and not yet freed */
+
+/*
+ * reserve - Make sure bytes more bytes fit at the bump pointer
+ */
+static int reserve(size_t bytes)
+{
+    size_t need;
+
+    if (bump + bytes <= arena_hi)
+	return 0;
+    need = bump + bytes - arena_hi;
+    if (need < ARENA_CHUNK)
+	need = ARENA_CHUNK;
+    if (mem_sbrk(need) == (void *)-1)
+	return -1;
+    arena_hi += need;
+    return 0;
+}
+
+/*
+ * arena_init - Start a new region on the empty heap
+ */
+static int arena_init(void)
+{
+    arena_lo = bump = arena_hi = mem_heap_lo();
+    last = NULL;
+    live = 0;
+    return 0;
+}
+
+/*
+ * arena_malloc - Bump-allocate a block
+ */
+static void *arena_malloc(size_t size)
+{
+    char *bp;
+
+    if (reserve(HDRSIZE + ALIGN(size)) < 0)
+	return NULL;
+    bp = bump + HDRSIZE;
+    CAP(bp) = ALIGN(size);
+    bump = bp + ALIGN(size);
+    last = bp;
+    live++;
+    return bp;
+}
+
+/*
+ * arena_free - Count the block out, and recycle the region once empty
+ */
+static void arena_free(void *bp)
+{
+    if (bp == NULL)
+	return;
+    if (--live == 0) {
+	mem_decommit(arena_lo, bump - arena_lo);
+	bump = arena_lo;
+	last = NULL;
+    }
+}
+
+/*
+ * arena_realloc - Grow the newest block in place, else move
+ */
+static void *arena_realloc(void *ptr, size_t size)
+{
+    void *newptr;
+
+    if (ptr == NULL)
+	return arena_malloc(size);
+    if (size <= CAP(ptr))
+	return ptr;
+    if (ptr == last) {
+	if (reserve(ALIGN(size) - CAP(ptr)) < 0)
+	    return NULL;
+	CAP(ptr) = ALIGN(size);
+	bump = (char *)ptr + ALIGN(size);
+	return ptr;
+    }
+    if ((newptr = arena_malloc(size)) == NULL)
+	return NULL;
+    memcpy(newptr, ptr, CAP(ptr));
+    arena_free(ptr);
+    return newptr;
+}
+
+mm_ops_t mm_backend = {
+    "arena", arena_init, arena_malloc, arena_free, arena_realloc, NULL, 1
+};
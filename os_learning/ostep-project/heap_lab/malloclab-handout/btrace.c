@@ -0,0 +1,333 @@
+/*
+ * btrace.c - reader and writer for the binary trace format in btrace.h
+ *
+ * The reader maps the whole file read-only and decodes requests on
+ * demand, so a trace of any length costs a few pages of page cache
+ * per pass instead of a heap-resident traceop_t array.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "btrace.h"
+
+/* Largest encoded record: type byte plus two 5-byte varints */
+#define MAX_RECORD 11
+
+/*
+ * Varint helpers - 7 bits per byte, low-order group first, high bit set
+ * on every byte but the last. Signed deltas are zig-zag encoded so that
+ * small negative steps stay small.
+ */
+static int put_varint(unsigned char *buf, uint32_t v)
+{
+    int n = 0;
+    while (v >= 0x80) {
+	buf[n++] = (unsigned char)(v | 0x80);
+	v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+    return n;
+}
+
+/*
+ * get_varint - Decode one varint that must end before end. Returns 0
+ *     on success, -1 if it runs off the end or past 5 bytes.
+ */
+static inline int get_varint(const unsigned char **pp,
+			     const unsigned char *end, uint32_t *vp)
+{
+    const unsigned char *p = *pp;
+    uint32_t v = 0;
+    int shift = 0;
+
+    while (p < end && (*p & 0x80)) {
+	if (shift == 28)
+	    return -1;
+	v |= (uint32_t)(*p++ & 0x7f) << shift;
+	shift += 7;
+    }
+    if (p >= end)
+	return -1;
+    v |= (uint32_t)*p++ << shift;
+    *pp = p;
+    *vp = v;
+    return 0;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/*****************
+ * Reader routines
+ *****************/
+
+/*
+ * btrace_is_binary - Peek at the first word of a file
+ */
+int btrace_is_binary(const char *path)
+{
+    FILE *fp;
+    uint32_t magic = 0;
+    int found;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+	return 0;
+    found = (fread(&magic, sizeof(magic), 1, fp) == 1 &&
+	     magic == BTRACE_MAGIC);
+    fclose(fp);
+    return found;
+}
+
+/*
+ * btrace_open - Map a binary trace and check that its header and
+ *     index are consistent with the file size.
+ */
+int btrace_open(const char *path, btrace_t *bt)
+{
+    int fd;
+    struct stat st;
+    btrace_hdr_t *hdr;
+    uint32_t expect, i;
+    uint64_t stream_len;
+
+    memset(bt, 0, sizeof(*bt));
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return -1;
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	return -1;
+    }
+    if ((size_t)st.st_size < sizeof(btrace_hdr_t)) {
+	close(fd);
+	errno = EINVAL;
+	return -1;
+    }
+
+    bt->maplen = (size_t)st.st_size;
+    bt->map = mmap(NULL, bt->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bt->map == MAP_FAILED) {
+	bt->map = NULL;
+	return -1;
+    }
+    madvise(bt->map, bt->maplen, MADV_SEQUENTIAL);
+
+    hdr = (btrace_hdr_t *)bt->map;
+    expect = (hdr->num_ops + hdr->index_stride - 1) /
+	(hdr->index_stride ? hdr->index_stride : 1);
+    if (hdr->magic != BTRACE_MAGIC || hdr->version != BTRACE_VERSION ||
+	hdr->num_ops < 0 || hdr->num_ids < 0 || hdr->index_stride == 0 ||
+	hdr->index_count != expect ||
+	hdr->index_offset < sizeof(btrace_hdr_t) ||
+	hdr->index_offset > bt->maplen ||
+	(uint64_t)hdr->index_count * sizeof(btrace_idx_t) >
+	bt->maplen - hdr->index_offset) {
+	btrace_close(bt);
+	errno = EINVAL;
+	return -1;
+    }
+
+    bt->hdr = *hdr;
+    bt->stream = bt->map + sizeof(btrace_hdr_t);
+    bt->stream_end = bt->map + hdr->index_offset;
+    bt->index = (const btrace_idx_t *)(bt->map + hdr->index_offset);
+
+    /* Every index entry has to point at a record inside the stream */
+    stream_len = (uint64_t)(bt->stream_end - bt->stream);
+    for (i = 0; i < hdr->index_count; i++) {
+	if (bt->index[i].offset >= stream_len) {
+	    btrace_close(bt);
+	    errno = EINVAL;
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * btrace_close - Unmap a trace opened by btrace_open
+ */
+void btrace_close(btrace_t *bt)
+{
+    if (bt->map)
+	munmap(bt->map, bt->maplen);
+    memset(bt, 0, sizeof(*bt));
+}
+
+/*
+ * btrace_rewind - Point a cursor at the first request
+ */
+void btrace_rewind(const btrace_t *bt, btrace_cursor_t *cur)
+{
+    cur->p = bt->stream;
+    cur->prev_index = 0;
+    cur->opnum = 0;
+}
+
+/*
+ * btrace_seek - Point a cursor at request opnum, using the trailing
+ *     index to skip all but the last partial stride.
+ */
+int btrace_seek(const btrace_t *bt, btrace_cursor_t *cur, int opnum)
+{
+    const btrace_idx_t *ent;
+    btrace_op_t op;
+    uint64_t stream_len = (uint64_t)(bt->stream_end - bt->stream);
+
+    if (opnum < 0 || opnum > bt->hdr.num_ops)
+	return -1;
+    if (opnum == bt->hdr.num_ops && opnum % bt->hdr.index_stride == 0) {
+	cur->p = bt->stream_end;
+	cur->prev_index = 0;
+	cur->opnum = opnum;
+	return 0;
+    }
+    ent = &bt->index[opnum / bt->hdr.index_stride];
+    if (ent->offset >= stream_len)
+	return -1;
+    cur->p = bt->stream + ent->offset;
+    cur->prev_index = ent->prev_index;
+    cur->opnum = (opnum / bt->hdr.index_stride) * bt->hdr.index_stride;
+    while (cur->opnum < opnum)
+	if (btrace_next(bt, cur, &op) != 1)
+	    return -1;
+    return 0;
+}
+
+/*
+ * btrace_next - Decode one request and advance the cursor. A record
+ *     that is cut off by the end of the stream or is otherwise
+ *     malformed leaves the cursor where it was.
+ */
+int btrace_next(const btrace_t *bt, btrace_cursor_t *cur, btrace_op_t *op)
+{
+    const unsigned char *p = cur->p;
+    uint32_t delta, size = 0;
+
+    if (cur->opnum >= bt->hdr.num_ops || p >= bt->stream_end)
+	return 0;
+
+    op->type = *p++;
+    if (op->type > BTRACE_REALLOC ||
+	get_varint(&p, bt->stream_end, &delta) < 0 ||
+	(op->type != BTRACE_FREE &&
+	 get_varint(&p, bt->stream_end, &size) < 0))
+	return -1;
+    op->index = cur->prev_index + unzigzag(delta);
+    op->size = (int)size;
+
+    cur->prev_index = op->index;
+    cur->p = p;
+    cur->opnum++;
+    return 1;
+}
+
+/*****************
+ * Writer routines
+ *****************/
+
+/*
+ * btrace_writer_open - Start a new binary trace. The header is written
+ *     as a placeholder and filled in by btrace_writer_close.
+ */
+int btrace_writer_open(btrace_writer_t *w, const char *path,
+		       int sugg_heapsize, int weight)
+{
+    memset(w, 0, sizeof(*w));
+    if ((w->fp = fopen(path, "wb")) == NULL)
+	return -1;
+
+    w->hdr.magic = BTRACE_MAGIC;
+    w->hdr.version = BTRACE_VERSION;
+    w->hdr.sugg_heapsize = sugg_heapsize;
+    w->hdr.weight = weight;
+    w->hdr.index_stride = BTRACE_INDEX_STRIDE;
+    w->max_index = -1;
+
+    if (fwrite(&w->hdr, sizeof(w->hdr), 1, w->fp) != 1) {
+	fclose(w->fp);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * btrace_writer_put - Append one request to the stream
+ */
+int btrace_writer_put(btrace_writer_t *w, int type, int index, int size)
+{
+    unsigned char rec[MAX_RECORD];
+    int n = 0;
+
+    if (w->hdr.num_ops % BTRACE_INDEX_STRIDE == 0) {
+	if (w->hdr.index_count == w->index_cap) {
+	    size_t cap = w->index_cap ? 2 * w->index_cap : 64;
+	    btrace_idx_t *idx = realloc(w->index, cap * sizeof(btrace_idx_t));
+	    if (idx == NULL)
+		return -1;
+	    w->index = idx;
+	    w->index_cap = cap;
+	}
+	w->index[w->hdr.index_count].offset = w->offset;
+	w->index[w->hdr.index_count].prev_index = w->prev_index;
+	w->index[w->hdr.index_count].pad = 0;
+	w->hdr.index_count++;
+    }
+
+    rec[n++] = (unsigned char)type;
+    n += put_varint(rec + n, zigzag(index - w->prev_index));
+    if (type != BTRACE_FREE)
+	n += put_varint(rec + n, (uint32_t)size);
+    if (fwrite(rec, 1, n, w->fp) != (size_t)n)
+	return -1;
+
+    w->offset += n;
+    w->prev_index = index;
+    if (type != BTRACE_FREE && index > w->max_index)
+	w->max_index = index;
+    w->hdr.num_ops++;
+    return 0;
+}
+
+/*
+ * btrace_writer_close - Write the index, patch the header and close
+ */
+int btrace_writer_close(btrace_writer_t *w)
+{
+    static const unsigned char zeros[sizeof(btrace_idx_t)];
+    size_t pad = (size_t)(-(sizeof(btrace_hdr_t) + w->offset) &
+			  (sizeof(btrace_idx_t) - 1));
+    int rc = 0;
+
+    /* Keep the index naturally aligned within the mapping */
+    if (pad && fwrite(zeros, 1, pad, w->fp) != pad)
+	rc = -1;
+
+    w->hdr.num_ids = w->max_index + 1;
+    w->hdr.index_offset = sizeof(btrace_hdr_t) + w->offset + pad;
+    if (w->hdr.index_count &&
+	fwrite(w->index, sizeof(btrace_idx_t), w->hdr.index_count, w->fp)
+	!= w->hdr.index_count)
+	rc = -1;
+    if (fseek(w->fp, 0, SEEK_SET) != 0 ||
+	fwrite(&w->hdr, sizeof(w->hdr), 1, w->fp) != 1)
+	rc = -1;
+    if (fclose(w->fp) != 0)
+	rc = -1;
+    free(w->index);
+    w->index = NULL;
+    return rc;
+}
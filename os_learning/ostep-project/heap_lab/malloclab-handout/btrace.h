@@ -0,0 +1,112 @@
+/*
+ * btrace.h - compact binary trace format for the malloc lab driver
+ *
+ * A binary trace file has three parts:
+ *
+ *   header   A fixed-size btrace_hdr_t carrying the same four numbers
+ *            as the header of a text (.rep) trace, plus the location
+ *            of the trailing index.
+ *   stream   One variable-length record per request. Each record is a
+ *            type byte, the zig-zag varint delta of the block index
+ *            from the previous record, and (for alloc/realloc only) the
+ *            varint byte size.
+ *   index    One btrace_idx_t every BTRACE_INDEX_STRIDE requests,
+ *            giving the stream offset and delta base of that request,
+ *            so a reader can start decoding anywhere in the stream.
+ *
+ * Header and index fields are stored in host byte order, which is
+ * little-endian on every machine the lab runs on.
+ */
+#ifndef __BTRACE_H_
+#define __BTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define BTRACE_MAGIC        0x5442544dU /* "MTBT" */
+#define BTRACE_VERSION      1
+#define BTRACE_INDEX_STRIDE 4096        /* requests per index entry */
+
+/* Request types; same order as the traceop_t enum in mdriver.c */
+#define BTRACE_ALLOC   0
+#define BTRACE_FREE    1
+#define BTRACE_REALLOC 2
+
+typedef struct {
+    uint32_t magic;         /* BTRACE_MAGIC */
+    uint32_t version;       /* BTRACE_VERSION */
+    int32_t sugg_heapsize;  /* suggested heap size (unused) */
+    int32_t num_ids;        /* number of alloc/realloc ids */
+    int32_t num_ops;        /* number of distinct requests */
+    int32_t weight;         /* weight for this trace (unused) */
+    uint32_t index_stride;  /* requests per index entry */
+    uint32_t index_count;   /* number of index entries */
+    uint64_t index_offset;  /* file offset of the trailing index */
+} btrace_hdr_t;
+
+typedef struct {
+    uint64_t offset;        /* stream offset of request i*index_stride */
+    int32_t prev_index;     /* delta base for that request */
+    uint32_t pad;
+} btrace_idx_t;
+
+/* A single decoded request */
+typedef struct {
+    int type;               /* BTRACE_ALLOC, BTRACE_FREE or BTRACE_REALLOC */
+    int index;              /* block id */
+    int size;               /* byte size (alloc/realloc only) */
+} btrace_op_t;
+
+/* A read-only mapping of a binary trace file */
+typedef struct {
+    btrace_hdr_t hdr;
+    unsigned char *map;        /* start of the mapping */
+    size_t maplen;             /* length of the mapping */
+    const unsigned char *stream;     /* first record */
+    const unsigned char *stream_end; /* one past the last record */
+    const btrace_idx_t *index;       /* trailing index */
+} btrace_t;
+
+/* Decoding position within a btrace_t */
+typedef struct {
+    const unsigned char *p;
+    int prev_index;
+    int opnum;              /* number of requests decoded so far */
+} btrace_cursor_t;
+
+/* Incremental writer used by the converters and generators */
+typedef struct {
+    FILE *fp;
+    btrace_hdr_t hdr;
+    uint64_t offset;        /* bytes of stream written so far */
+    int prev_index;
+    int max_index;
+    btrace_idx_t *index;
+    size_t index_cap;
+} btrace_writer_t;
+
+/* Returns 1 if the file at path starts with the binary trace magic */
+int btrace_is_binary(const char *path);
+
+/* Map a binary trace read-only. Returns 0 on success, -1 on error */
+int btrace_open(const char *path, btrace_t *bt);
+void btrace_close(btrace_t *bt);
+
+/* Position a cursor at the first request, or at request opnum */
+void btrace_rewind(const btrace_t *bt, btrace_cursor_t *cur);
+int btrace_seek(const btrace_t *bt, btrace_cursor_t *cur, int opnum);
+
+/*
+ * Decode the next request. Returns 1 on success, 0 at end of stream,
+ * -1 on a malformed record. btrace_seek also fails on one.
+ */
+int btrace_next(const btrace_t *bt, btrace_cursor_t *cur, btrace_op_t *op);
+
+/* Write a binary trace. Returns 0 on success, -1 on error */
+int btrace_writer_open(btrace_writer_t *w, const char *path,
+		       int sugg_heapsize, int weight);
+int btrace_writer_put(btrace_writer_t *w, int type, int index, int size);
+int btrace_writer_close(btrace_writer_t *w);
+
+#endif /* __BTRACE_H_ */
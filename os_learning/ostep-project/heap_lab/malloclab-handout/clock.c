@@ -1,5 +1,5 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
  *           Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
@@ -9,9 +9,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
 
 /******************************************************* 
  * Machine dependent functions 
@@ -21,55 +26,115 @@
  * You can verify this for yourself using gcc -v.
  *******************************************************/
 
-#if defined(__i386__)  
+#if defined(__i386__) || defined(__x86_64__)
 /*******************************************************
- * Pentium versions of start_counter() and get_counter()
+ * x86 and x86-64 versions of start_counter() and get_counter()
+ *
+ * On current parts the TSC ticks at a fixed rate whatever the core
+ * clock is doing ("invariant TSC"), so it is really a fine-grained
+ * wall clock. rdtsc is not ordered with the surrounding code, so
+ * start_counter fences before its read to let earlier work finish,
+ * and get_counter uses rdtscp, which waits for the timed code, with
+ * a fence after it to hold back what follows. Every x86 processor
+ * since 2008 has rdtscp, and both instructions work the same in
+ * 32-bit mode, so the -m32 build uses them too.
  *******************************************************/
 
+static unsigned long long cyc_start = 0;
 
-/* $begin x86cyclecounter */
-/* Initialize the cycle counter */
-static unsigned cyc_hi = 0;
-static unsigned cyc_lo = 0;
+static inline unsigned long long tsc_begin(void)
+{
+    unsigned hi, lo;
 
+    asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
 
-/* Set *hi and *lo to the high and low order bits  of the cycle counter.  
-   Implementation requires assembly code to use the rdtsc instruction. */
-void access_counter(unsigned *hi, unsigned *lo)
+static inline unsigned long long tsc_end(void)
 {
-    asm("rdtsc; movl %%edx,%0; movl %%eax,%1"   /* Read cycle counter */
-	: "=r" (*hi), "=r" (*lo)                /* and move results to */
-	: /* No input */                        /* the two outputs */
-	: "%edx", "%eax");
+    unsigned hi, lo, aux;
+
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) 
+		 : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
 }
 
 /* Record the current value of the cycle counter. */
 void start_counter()
 {
-    access_counter(&cyc_hi, &cyc_lo);
+    cyc_start = tsc_begin();
 }
 
 /* Return the number of cycles since the last call to start_counter. */
 double get_counter()
 {
-    unsigned ncyc_hi, ncyc_lo;
-    unsigned hi, lo, borrow;
-    double result;
+    return (double)(tsc_end() - cyc_start);
+}
 
-    /* Get cycle counter */
-    access_counter(&ncyc_hi, &ncyc_lo);
+/* Nanoseconds on the clock that NTP does not slew */
+static double raw_ns(void)
+{
+    struct timespec ts;
 
-    /* Do double precision subtraction */
-    lo = ncyc_lo - cyc_lo;
-    borrow = lo > ncyc_lo;
-    hi = ncyc_hi - cyc_hi - borrow;
-    result = (double) hi * (1 << 30) * 4 + lo;
-    if (result < 0) {
-	fprintf(stderr, "Error: counter returns neg value: %.0f\n", result);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* 
+ * tsc_calibrate - Measure the TSC rate in MHz against CLOCK_MONOTONIC_RAW
+ *     over a few 10 ms windows and keep the median
+ */
+static double tsc_calibrate(void)
+{
+    double rate[5], t0, t1, tmp;
+    unsigned long long c0, c1;
+    int i, j;
+
+    for (i = 0; i < 5; i++) {
+	t0 = raw_ns();
+	c0 = tsc_begin();
+	do
+	    t1 = raw_ns();
+	while (t1 - t0 < 10e6);
+	c1 = tsc_end();
+	rate[i] = (c1 - c0) / ((t1 - t0) * 1e-3);
+	for (j = i; j > 0 && rate[j-1] > rate[j]; j--) {
+	    tmp = rate[j-1];
+	    rate[j-1] = rate[j];
+	    rate[j] = tmp;
+	}
     }
-    return result;
+    return rate[2];
+}
+
+/* 
+ * tsc_mhz - Rate of the TSC in MHz. Intel parts report it in cpuid leaf
+ *     0x15 as a ratio to the crystal clock; elsewhere (AMD, most VMs),
+ *     or if the crystal rate is missing, it is measured.
+ */
+static double tsc_mhz(int verbose)
+{
+    unsigned a, b, c, d;
+    double rate = 0;
+    char *source = "cpuid";
+
+    if (__get_cpuid(0x80000007, &a, &b, &c, &d) && !(d & (1 << 8)) && 
+	verbose)
+	printf("Warning: TSC is not invariant; cycle counts may drift\n");
+
+    if (__get_cpuid_max(0, NULL) >= 0x15) {
+	__cpuid(0x15, a, b, c, d);
+	if (a != 0 && b != 0 && c != 0)
+	    rate = (double)c * b / a / 1e6;
+    }
+    if (rate == 0) {
+	rate = tsc_calibrate();
+	source = "CLOCK_MONOTONIC_RAW";
+    }
+    if (verbose)
+	printf("TSC rate ~= %.1f MHz (from %s)\n", rate, source);
+    return rate;
 }
-/* $end x86cyclecounter */
 
 #elif defined(__alpha)
 
@@ -140,23 +205,29 @@ double get_counter()
  * counter routines. Newer models of sparcs (v8plus) have cycle
  * counters that can be accessed from user programs, but since there
  * are still many sparc boxes out there that don't support this, we
- * haven't provided a Sparc version here.
+ * haven't provided a Sparc version here. Instead the "cycles" are
+ * nanoseconds of CLOCK_MONOTONIC_RAW, a 1000 MHz clock that NTP
+ * does not slew.
  ***************************************************************/
 
+static double ns_start = 0;
+
+static double raw_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
 void start_counter()
 {
-    printf("ERROR: You are trying to use a start_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    ns_start = raw_ns();
 }
 
 double get_counter() 
 {
-    printf("ERROR: You are trying to use a get_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    return raw_ns() - ns_start;
 }
 #endif
 
@@ -195,10 +266,22 @@ double mhz_full(int verbose, int sleeptime)
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* 
+ * Version using a default sleeptime, except where the counter rate
+ * can be found more precisely: from cpuid or a short calibration for
+ * the x86 TSC, and by definition for the nanosecond clock
+ */
 double mhz(int verbose)
 {
+#if defined(__i386__) || defined(__x86_64__)
+    return tsc_mhz(verbose);
+#elif defined(__alpha)
     return mhz_full(verbose, 2);
+#else
+    if (verbose)
+	printf("Using CLOCK_MONOTONIC_RAW at 1000 MHz\n");
+    return 1000.0;
+#endif
 }
 
 /** Special counters that compensate for timer interrupt overhead */
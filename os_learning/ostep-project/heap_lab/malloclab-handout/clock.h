@@ -9,7 +9,8 @@ double get_counter();
 /* Measure overhead for counter */
 double ovhd();
 
-/* Determine clock rate of processor (using a default sleeptime) */
+/* Determine clock rate of processor (using a default sleeptime, or the
+   TSC rate from cpuid or calibration on x86) */
 double mhz(int verbose);
 
 /* Determine clock rate of processor, having more control over accuracy */
@@ -12,27 +12,23 @@
  * This is the default path where the driver will look for the
  * default tracefiles. You can override it at runtime with the -t flag.
  */
-#define TRACEDIR "/afs/cs/project/ics2/im/labs/malloclab/traces/"
+#define TRACEDIR "./traces/"
 
 /*
  * This is the list of default tracefiles in TRACEDIR that the driver
  * will use for testing. Modify this if you want to add or delete
- * traces from the driver's test suite. For example, if you don't want
- * your students to implement realloc, you can delete the last two
- * traces.
+ * traces from the driver's test suite. The bundled traces are made
+ * by tracegen from the matching .param files (see "make traces"). 
+ * For example, if you don't want your students to implement realloc, 
+ * you can delete the growth and mixed traces.
  */
 #define DEFAULT_TRACEFILES \
-  "amptjp-bal.rep",\
-  "cccp-bal.rep",\
-  "cp-decl-bal.rep",\
-  "expr-bal.rep",\
-  "coalescing-bal.rep",\
-  "random-bal.rep",\
-  "random2-bal.rep",\
-  "binary-bal.rep",\
-  "binary2-bal.rep",\
-  "realloc-bal.rep",\
-  "realloc2-bal.rep"
+  "bimodal-bal.rep",\
+  "powerlaw-bal.rep",\
+  "phase-bal.rep",\
+  "handoff-bal.rep",\
+  "growth-bal.rep",\
+  "mixed-bal.rep"
 
 /*
  * This constant gives the estimated performance of the libc malloc
@@ -62,11 +58,28 @@
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Set MEM_USE_MMAP to 1 to model the heap as a reserved range of
+ * address space whose pages memlib commits and decommits as the brk
+ * moves. The heap can then shrink and grow up to MEM_RESERVE bytes, and
+ * the driver also reports resident-set utilization and page faults.
+ * Set it to 0 for the original MAX_HEAP byte array from malloc.
+ */
+#define MEM_USE_MMAP 1
+
+/* Address space reserved for the heap when MEM_USE_MMAP is set */
+#if defined(__LP64__)
+#define MEM_RESERVE ((size_t)1 << 36)  /* 64 GB */
+#else
+#define MEM_RESERVE ((size_t)1 << 30)  /* 1 GB */
+#endif
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_FCYC   1   /* cycle counter w/K-best scheme (TSC on x86, 
+                          CLOCK_MONOTONIC_RAW elsewhere) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
 
 #endif /* __CONFIG_H */
@@ -10,6 +10,9 @@
 #include <stdlib.h>
 #include <sys/times.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
 
 #include "fcyc.h"
 #include "clock.h"
@@ -20,21 +23,24 @@
 #define EPSILON 0.01         /* K samples should be EPSILON of each other*/
 #define COMPENSATE 0         /* 1-> try to compensate for clock ticks */
 #define CLEAR_CACHE 0        /* Clear cache before running test function */
-#define CACHE_BYTES (1<<19)  /* Max cache size in bytes */
-#define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define CACHE_BYTES (1<<19)  /* Max cache size in bytes, if not found */
+#define CACHE_BLOCK 32       /* Cache block size in bytes, if not found */
 
 static int kbest = K;
 static int maxsamples = MAXSAMPLES;
 static double epsilon = EPSILON;
 static int compensate = COMPENSATE;
 static int clear_cache = CLEAR_CACHE;
-static int cache_bytes = CACHE_BYTES;
-static int cache_block = CACHE_BLOCK;
+static int cache_bytes = 0;  /* 0 -> size of the last-level cache */
+static int cache_block = 0;  /* 0 -> L1 data cache line size */
 
 static int *cache_buf = NULL;
 
 static double *values = NULL;
 static int samplecount = 0;
+static double samplesum = 0;    /* sum of all samples */
+static double samplesumsq = 0;  /* and of their squares */
+static fcyc_stats_t last_stats;
 
 /* for debugging only */
 #define KEEP_VALS 0
@@ -59,6 +65,8 @@ static void init_sampler()
     samples = calloc(maxsamples+kbest, sizeof(double));
 #endif
     samplecount = 0;
+    samplesum = 0;
+    samplesumsq = 0;
 }
 
 /* 
@@ -78,6 +86,8 @@ static void add_sample(double val)
     samples[samplecount] = val;
 #endif
     samplecount++;
+    samplesum += val;
+    samplesumsq += val*val;
     /* Insertion sort */
     while (pos > 0 && values[pos-1] > values[pos]) {
 	double temp = values[pos-1];
@@ -97,6 +107,96 @@ static int has_converged()
 	((1 + epsilon)*values[0] >= values[kbest-1]);
 }
 
+/* 
+ * record_stats - Describe the samples of the measurement just finished.
+ *     The confidence interval of the mean uses Student's t, since there
+ *     are rarely more than a handful of samples.
+ */
+static void record_stats()
+{
+    static double t975[] = {12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 
+			    2.31, 2.26, 2.23, 2.20, 2.18, 2.16, 2.14, 
+			    2.13, 2.12, 2.11, 2.10, 2.09, 2.09};
+    int n = samplecount;
+    int nt = sizeof(t975)/sizeof(double);
+    double var;
+
+    last_stats.samples = n;
+    last_stats.converged = has_converged();
+    last_stats.best = values[0];
+    last_stats.kth = values[(n < kbest ? n : kbest) - 1];
+    last_stats.mean = samplesum / n;
+    last_stats.ci95 = 0;
+    if (n > 1) {
+	var = (samplesumsq - samplesum*samplesum/n) / (n-1);
+	if (var > 0)
+	    last_stats.ci95 = (n-1 <= nt ? t975[n-2] : 1.96) * sqrt(var/n);
+    }
+}
+
+/*
+ * read_cache_size - Parse a sysfs cache size such as "32768K"
+ */
+static long read_cache_size(char *path)
+{
+    FILE *fp;
+    long size = 0;
+    char unit = 0;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return 0;
+    if (fscanf(fp, "%ld%c", &size, &unit) < 1)
+	size = 0;
+    fclose(fp);
+    if (unit == 'K')
+	size <<= 10;
+    else if (unit == 'M')
+	size <<= 20;
+    return size;
+}
+
+/*
+ * find_cache - Fill in whichever of cache_bytes and cache_block were not
+ *     set, from sysconf where the C library knows the cache geometry,
+ *     else from cpu0's sysfs cache entries, else the old defaults
+ */
+static void find_cache()
+{
+    char path[128];
+    long size, level, best_level = 0, llc = 0, line = 0;
+    int i, found_llc;
+
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    if ((llc = sysconf(_SC_LEVEL4_CACHE_SIZE)) <= 0 &&
+	(llc = sysconf(_SC_LEVEL3_CACHE_SIZE)) <= 0 &&
+	(llc = sysconf(_SC_LEVEL2_CACHE_SIZE)) <= 0)
+	llc = 0;
+    if ((line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE)) < 0)
+	line = 0;
+#endif
+    found_llc = (llc > 0);
+    for (i = 0; i < 16 && (!found_llc || line == 0); i++) {
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+	if ((level = read_cache_size(path)) == 0)
+	    break;
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+	size = read_cache_size(path);
+	if (!found_llc && level > best_level && size > 0) {
+	    best_level = level;
+	    llc = size;
+	}
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/"
+		"coherency_line_size", i);
+	if (line == 0)
+	    line = read_cache_size(path);
+    }
+
+    if (cache_bytes == 0)
+	cache_bytes = (llc > 0) ? (int)llc : CACHE_BYTES;
+    if (cache_block == 0)
+	cache_block = (line > 0) ? (int)line : CACHE_BLOCK;
+}
+
 /* 
  * clear - Code to clear cache 
  */
@@ -106,13 +206,19 @@ static void clear()
 {
     int x = sink;
     int *cptr, *cend;
-    int incr = cache_block/sizeof(int);
+    int incr;
+
+    if (cache_bytes == 0 || cache_block == 0)
+	find_cache();
+    incr = cache_block/sizeof(int);
     if (!cache_buf) {
 	cache_buf = malloc(cache_bytes);
 	if (!cache_buf) {
 	    fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
 	    exit(1);
 	}
+	/* Give the buffer real pages; untouched ones all read the zero page */
+	memset(cache_buf, 1, cache_bytes);
     }
     cptr = (int *) cache_buf;
     cend = cptr + cache_bytes/sizeof(int);
@@ -160,6 +266,7 @@ double fcyc(test_funct f, void *argp)
     }
 #endif
     result = values[0];
+    record_stats();
 #if !KEEP_VALS
     free(values); 
     values = NULL;
@@ -168,6 +275,14 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * fcyc_last_stats - Describe the samples of the last call to fcyc
+ */
+void fcyc_last_stats(fcyc_stats_t *stats)
+{
+    *stats = last_stats;
+}
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
@@ -184,7 +299,8 @@ void set_fcyc_clear_cache(int clear)
 
 /* 
  * set_fcyc_cache_size - Set size of cache to use when clearing cache 
- *     Default = 1<<19 (512KB)
+ *     Default = size of the last-level cache, or 1<<19 (512KB) if it
+ *     cannot be found
  */
 void set_fcyc_cache_size(int bytes)
 {
@@ -197,9 +313,19 @@ void set_fcyc_cache_size(int bytes)
     }
 }
 
+/*
+ * get_fcyc_cache_size - Size of cache used when clearing cache
+ */
+int get_fcyc_cache_size(void)
+{
+    if (cache_bytes == 0)
+	find_cache();
+    return cache_bytes;
+}
+
 /* 
  * set_fcyc_cache_block - Set size of cache block 
- *     Default = 32
+ *     Default = L1 data cache line size, or 32 if it cannot be found
  */
 void set_fcyc_cache_block(int bytes) {
     cache_block = bytes;
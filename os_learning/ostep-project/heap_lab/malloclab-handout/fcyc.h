@@ -13,6 +13,19 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* How the samples behind the last fcyc result were distributed */
+typedef struct {
+    int samples;    /* number of samples taken */
+    int converged;  /* were the K best within epsilon of each other? */
+    double best;    /* smallest sample (the result) */
+    double kth;     /* Kth smallest sample */
+    double mean;    /* mean of all samples */
+    double ci95;    /* half-width of the 95% confidence interval of mean */
+} fcyc_stats_t;
+
+/* Describe the samples of the last call to fcyc */
+void fcyc_last_stats(fcyc_stats_t *stats);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -26,13 +39,19 @@ void set_fcyc_clear_cache(int clear);
 
 /* 
  * set_fcyc_cache_size - Set size of cache to use when clearing cache 
- *     Default = 1<<19 (512KB)
+ *     Default = size of the last-level cache, or 1<<19 (512KB) if it
+ *     cannot be found
  */
 void set_fcyc_cache_size(int bytes);
 
+/*
+ * get_fcyc_cache_size - Size of cache used when clearing cache
+ */
+int get_fcyc_cache_size(void);
+
 /* 
  * set_fcyc_cache_block - Set size of cache block 
- *     Default = 32
+ *     Default = L1 data cache line size, or 32 if it cannot be found
  */
 void set_fcyc_cache_block(int bytes);
 
@@ -23,10 +23,15 @@ void init_fsecs(void)
     if (verbose)
 	printf("Measuring performance with a cycle counter.\n");
 
-    /* set key parameters for the fcyc package */
+    /* 
+     * set key parameters for the fcyc package. Compensating for timer
+     * interrupts assumes a periodic tick charged in times(), which
+     * tickless kernels no longer have; the K-best minimum already 
+     * throws away interrupted samples.
+     */
     set_fcyc_maxsamples(20); 
     set_fcyc_clear_cache(1);
-    set_fcyc_compensate(1);
+    set_fcyc_compensate(0);
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
     Mhz = mhz(verbose > 0);
@@ -39,6 +44,20 @@ void init_fsecs(void)
 #endif
 }
 
+/*
+ * set_fsecs_workers - Tell the timing package that it is one of n
+ *     workers timing at once on cores that share the last-level cache.
+ *     Each then clears only its share of that cache, so that one 
+ *     worker's flush does not evict the others' working sets.
+ */
+void set_fsecs_workers(int n)
+{
+#if USE_FCYC
+    if (n > 1)
+	set_fcyc_cache_size(get_fcyc_cache_size() / n);
+#endif
+}
+
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
@@ -46,7 +65,19 @@ double fsecs(fsecs_test_funct f, void *argp)
 {
 #if USE_FCYC
     double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
+    double scale = 1.0/(Mhz*1e6);
+    fcyc_stats_t st;
+
+    /* Show how well the K best samples agreed, and how noisy all were */
+    if (verbose > 1) {
+	fcyc_last_stats(&st);
+	printf("K-best: %.6f secs (%d samples, K best within %.2f%%%s); "
+	       "mean %.6f +/- %.6f secs (95%% CI)\n",
+	       st.best*scale, st.samples, 100.0*(st.kth - st.best)/st.best,
+	       st.converged ? "" : ", NOT converged",
+	       st.mean*scale, st.ci95*scale);
+    }
+    return cycles*scale;
 #elif USE_ITIMER
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
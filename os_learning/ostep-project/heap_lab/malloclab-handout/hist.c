@@ -0,0 +1,100 @@
+/*
+ * hist.c - log-bucketed latency histograms (see hist.h)
+ */
+#include <string.h>
+
+#include "hist.h"
+
+/*
+ * bucket_of - Map a value to its bucket. With m = HIST_SUB and
+ *     shift = max(msb(v) - HIST_SUB_BITS, 0), the bucket is
+ *     shift*m + (v >> shift), where v >> shift lies in [m, 2m)
+ *     whenever shift > 0.
+ */
+static inline int bucket_of(uint64_t v)
+{
+    int msb, shift;
+
+    if (v < 2 * HIST_SUB)
+	return (int)v;
+    msb = 63 - __builtin_clzll(v);
+    shift = msb - HIST_SUB_BITS;
+    return shift * HIST_SUB + (int)(v >> shift);
+}
+
+/*
+ * bucket_value - Representative (midpoint) value of a bucket
+ */
+static uint64_t bucket_value(int b)
+{
+    int shift;
+    uint64_t lo;
+
+    if (b < 2 * HIST_SUB)
+	return (uint64_t)b;
+    shift = b / HIST_SUB - 1;
+    lo = (uint64_t)(b - shift * HIST_SUB) << shift;
+    return lo + ((1ULL << shift) >> 1);
+}
+
+/*
+ * hist_reset - Empty a histogram
+ */
+void hist_reset(hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/*
+ * hist_record - Count one value
+ */
+void hist_record(hist_t *h, uint64_t v)
+{
+    h->counts[bucket_of(v)]++;
+    h->total++;
+    if (v > h->max)
+	h->max = v;
+}
+
+/*
+ * hist_merge - Add the counts of src into dst
+ */
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+	dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    if (src->max > dst->max)
+	dst->max = src->max;
+}
+
+/*
+ * hist_percentile - Smallest bucket value with at least pct percent of
+ *     the recorded values at or below it. The top bucket is clamped to
+ *     the exact maximum.
+ */
+uint64_t hist_percentile(const hist_t *h, double pct)
+{
+    uint64_t rank, seen = 0;
+    uint64_t v;
+    int i;
+
+    if (h->total == 0)
+	return 0;
+    rank = (uint64_t)(pct / 100.0 * h->total + 0.5);
+    if (rank < 1)
+	rank = 1;
+    if (rank > h->total)
+	rank = h->total;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->counts[i];
+	if (seen >= rank) {
+	    v = bucket_value(i);
+	    return (v > h->max) ? h->max : v;
+	}
+    }
+    return h->max;
+}
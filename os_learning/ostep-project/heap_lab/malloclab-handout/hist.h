@@ -0,0 +1,31 @@
+/*
+ * hist.h - log-bucketed latency histograms
+ *
+ * Values below 2*HIST_SUB are counted exactly. Above that, every power
+ * of two is split into HIST_SUB equal sub-buckets, so any recorded
+ * value is reported within 1/HIST_SUB (about 3%) of its true value,
+ * from nanoseconds up to the full 64-bit range, in a fixed 15 KB.
+ */
+#ifndef __HIST_H_
+#define __HIST_H_
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)       /* sub-buckets per octave */
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;   /* number of recorded values */
+    uint64_t max;     /* largest recorded value */
+} hist_t;
+
+void hist_reset(hist_t *h);
+void hist_record(hist_t *h, uint64_t v);
+void hist_merge(hist_t *dst, const hist_t *src);
+
+/* Value at percentile pct (0..100), or 0 if the histogram is empty */
+uint64_t hist_percentile(const hist_t *h, double pct);
+
+#endif /* __HIST_H_ */
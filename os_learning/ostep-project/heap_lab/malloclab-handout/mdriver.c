@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE     /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,10 +16,18 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <dlfcn.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "btrace.h"
+#include "hist.h"
 #include "config.h"
 
 /**********************
@@ -29,6 +38,8 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define NUM_SIZECLASSES 6 /* size classes in the per-op latency histograms */
+#define MAXCORES     1024 /* most cores -j will spread workers over */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
@@ -46,7 +57,9 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC = BTRACE_ALLOC, 
+	  FREE = BTRACE_FREE, 
+	  REALLOC = BTRACE_REALLOC} type; /* type of request */
     int index;                        /* index for free() to use later */
     int size;                         /* byte size of alloc/realloc request */
 } traceop_t;
@@ -57,11 +70,24 @@ typedef struct {
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
+    traceop_t *ops;      /* array of requests (text traces only) */
+    btrace_t *bin;       /* mapped request stream (binary traces only) */
+    size_t trace_bytes;  /* bytes of storage holding the requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
 
+/* 
+ * Walks the requests of a trace in order. Text traces hand out
+ * pointers into their ops array; binary traces decode each request 
+ * into op as they go.
+ */
+typedef struct {
+    int opnum;             /* number of requests handed out so far */
+    traceop_t op;          /* most recently decoded request */
+    btrace_cursor_t bcur;  /* position in the binary stream */
+} tracecur_t;
+
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -81,10 +107,30 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double rss_util; /* utilization against the peak resident heap bytes */
+    double faults;   /* minor page faults while measuring utilization */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* 
+ * Per-op latency histograms for some malloc function, in ns, split by 
+ * request type (indexed like traceop_t's type) and by size class 
+ */
+typedef struct {
+    hist_t hist[3][NUM_SIZECLASSES];
+} latency_t;
+
+/* 
+ * What a -j worker hands back for its trace, in memory shared with 
+ * the parent 
+ */
+typedef struct {
+    stats_t stats;   /* the trace's stats */
+    latency_t lat;   /* its per-op latencies */
+    int errors;      /* errors found while running it */
+} result_t;
+
 /********************
  * Global variables
  *******************/
@@ -100,6 +146,29 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* Upper bounds (inclusive) of all but the last latency size class */
+static int sizeclass_max[NUM_SIZECLASSES-1] = {64, 256, 1024, 4096, 16384};
+
+/* Cost of one op_clock() pair, subtracted from every per-op sample */
+static uint64_t op_clock_ovhd = 0;
+
+/* The student's package in mm.c, and the system allocator for -b libc */
+static int libc_init(void);
+static mm_ops_t mm_builtin = {
+    "mm", mm_init, mm_malloc, mm_free, mm_realloc, NULL, 1
+};
+static mm_ops_t libc_backend = {
+    "libc", libc_init, malloc, free, realloc, NULL, 0
+};
+
+/* The package under test: mm.c, except while the -b backends run */
+static mm_ops_t *mm = &mm_builtin;
+
+/* Number of traces to evaluate at once (-j), and the cores to use */
+static int jobs = 1;
+static int cores[MAXCORES];
+static int num_cores = 0;
+
 
 /********************* 
  * Function prototypes 
@@ -113,8 +182,13 @@ static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static void read_text_trace(trace_t *trace, char *path);
 static void free_trace(trace_t *trace);
 
+/* These functions walk the requests of a trace */
+static void trace_rewind(trace_t *trace, tracecur_t *cur);
+static inline traceop_t *trace_next(trace_t *trace, tracecur_t *cur);
+
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
@@ -122,15 +196,44 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static void eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			 stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void touch_payload(char *p, int size);
+static int mm_start(void);
+
+/* These functions load allocator backends and run them on every trace */
+static mm_ops_t *load_backend(char *path);
+static void eval_backend(char **tracefiles, int n, stats_t *stats,
+			 latency_t *lat);
+static void eval_trace(char *tracefile, int tracenum, stats_t *stats,
+		       latency_t *lat, range_t **ranges);
+static void eval_parallel(char **tracefiles, int n, stats_t *stats,
+			  latency_t *lat);
+
+/* These functions choose and claim cores for the -j workers */
+static int parse_cpulist(char *list, cpu_set_t *set);
+static void pick_cores(char *list);
+static void pin_to_core(int core);
+
+/* These functions time individual requests for the latency histograms */
+static inline uint64_t op_clock(void);
+static void calibrate_op_clock(void);
+static inline void record_latency(latency_t *lat, int type, int size,
+				  uint64_t start, uint64_t end);
+static void eval_libc_latency(trace_t *trace, latency_t *lat);
+static void eval_mm_latency(trace_t *trace, latency_t *lat);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(latency_t *lat);
+static void printcompare(char *name, int n, stats_t *stats, latency_t *lat,
+			 int has_util);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
+static double wall_secs(void);
 
 /**************
  * Main routine
@@ -142,14 +245,22 @@ int main(int argc, char **argv)
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    latency_t *libc_lat = NULL;/* libc per-op latencies over all traces */
+    latency_t *mm_lat = NULL;  /* mm per-op latencies over all traces */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    mm_ops_t **backends = NULL;/* allocators named by -b */
+    int num_backends = 0;      /* the number of them */
+    stats_t **be_stats = NULL; /* their stats for each trace */
+    latency_t **be_lat = NULL; /* and their per-op latencies */
+    int saved_errors;
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int run_latency = 0; /* If set, time every request (set by -L) */
+    char *corelist = NULL; /* Cores for the -j workers (set by -C) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +269,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:b:j:C:hvVgalL")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -178,12 +289,30 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 'b': /* Also run the allocator in this shared object */
+	    backends = realloc(backends, (num_backends+1)*sizeof(mm_ops_t *));
+	    if (backends == NULL)
+		unix_error("ERROR: realloc failed in main");
+	    backends[num_backends++] = load_backend(optarg);
+	    break;
+        case 'j': /* Evaluate this many traces at once */
+	    if ((jobs = atoi(optarg)) < 1)
+		jobs = 1;
+	    if (jobs > MAXCORES)
+		jobs = MAXCORES;
+	    break;
+        case 'C': /* Run the -j workers on these cores only */
+	    corelist = optarg;
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Build per-op latency histograms */
+            run_latency = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -235,8 +364,20 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /* Claim one core per -j worker; -C alone means use all its cores */
+    if (corelist != NULL && jobs == 1)
+	jobs = MAXCORES;
+    if (jobs > 1)
+	pick_cores(corelist);
+
     /* Initialize the timing package */
     init_fsecs();
+    if (run_latency || num_backends > 0) {
+	calibrate_op_clock();
+	if ((libc_lat = (latency_t *)calloc(1, sizeof(latency_t))) == NULL ||
+	    (mm_lat = (latency_t *)calloc(1, sizeof(latency_t))) == NULL)
+	    unix_error("latency calloc in main failed");
+    }
 
     /*
      * Optionally run and evaluate the libc malloc package 
@@ -262,6 +403,8 @@ int main(int argc, char **argv)
 		if (verbose > 1)
 		    printf("and performance.\n");
 		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+		if (libc_lat != NULL)
+		    eval_libc_latency(trace, libc_lat);
 	    }
 	    free_trace(trace);
 	}
@@ -288,24 +431,7 @@ int main(int argc, char **argv)
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
-    }
+    eval_backend(tracefiles, num_tracefiles, mm_stats, mm_lat);
 
     /* Display the mm results in a compact table */
     if (verbose) {
@@ -314,6 +440,62 @@ int main(int argc, char **argv)
 	printf("\n");
     }
 
+    /* Display the tail latencies of both packages */
+    if (run_latency) {
+	if (run_libc) {
+	    printf("Per-op latency for libc malloc:\n");
+	    printlatency(libc_lat);
+	}
+	printf("Per-op latency for mm malloc:\n");
+	printlatency(mm_lat);
+	printf("\n");
+    }
+
+    /*
+     * Optionally run the -b backends on the same traces and compare 
+     * them with mm (and libc, with -l) in one table. Their errors are
+     * reported but do not count against mm's performance index.
+     */
+    if (num_backends > 0) {
+	if ((be_stats = (stats_t **)calloc(num_backends, sizeof(stats_t *)))
+	    == NULL ||
+	    (be_lat = (latency_t **)calloc(num_backends, sizeof(latency_t *)))
+	    == NULL)
+	    unix_error("backend calloc in main failed");
+	saved_errors = errors;
+	for (i=0; i < num_backends; i++) {
+	    if ((be_stats[i] = (stats_t *)calloc(num_tracefiles, 
+						 sizeof(stats_t))) == NULL ||
+		(be_lat[i] = (latency_t *)calloc(1, sizeof(latency_t))) == NULL)
+		unix_error("backend calloc in main failed");
+	    mm = backends[i];
+	    errors = 0;
+	    if (verbose > 1)
+		printf("\nTesting %s malloc\n", mm->name);
+	    eval_backend(tracefiles, num_tracefiles, be_stats[i], be_lat[i]);
+	    if (verbose) {
+		printf("\nResults for %s malloc:\n", mm->name);
+		printresults(num_tracefiles, be_stats[i]);
+	    }
+	}
+	mm = &mm_builtin;
+	errors = saved_errors;
+
+	printf("\nComparison over all traces (latency in ns):\n");
+	printf("%-16s%6s%6s", "malloc", "valid", "util");
+#if MEM_USE_MMAP
+	printf("%6s", "rss");
+#endif
+	printf("%8s%8s%8s%8s\n", "Kops", "p50", "p99", "p99.9");
+	printcompare(mm_builtin.name, num_tracefiles, mm_stats, mm_lat, 1);
+	if (run_libc)
+	    printcompare("libc", num_tracefiles, libc_stats, libc_lat, 0);
+	for (i=0; i < num_backends; i++)
+	    printcompare(backends[i]->name, num_tracefiles, be_stats[i], 
+			 be_lat[i], backends[i]->uses_memlib);
+	printf("\n");
+    }
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -396,8 +578,9 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if (mm->uses_memlib && 
+	((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -469,17 +652,16 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. Binary
+ *     traces (see btrace.h) are mapped rather than parsed, so only 
+ *     the per-block arrays are allocated on the heap.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
-    FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    double start;
+    struct rusage ru;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -487,10 +669,65 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* Allocate the trace record */
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
 	unix_error("malloc 1 failed in read_trance");
+    trace->ops = NULL;
+    trace->bin = NULL;
 	
-    /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
+    start = wall_secs();
+    if (btrace_is_binary(path)) {
+	if ((trace->bin = (btrace_t *)malloc(sizeof(btrace_t))) == NULL)
+	    unix_error("malloc 2 failed in read_trace");
+	if (btrace_open(path, trace->bin) < 0) {
+	    sprintf(msg, "Could not map %s in read_trace", path);
+	    unix_error(msg);
+	}
+	trace->sugg_heapsize = trace->bin->hdr.sugg_heapsize;
+	trace->num_ids = trace->bin->hdr.num_ids;
+	trace->num_ops = trace->bin->hdr.num_ops;
+	trace->weight = trace->bin->hdr.weight;
+	trace->trace_bytes = trace->bin->maplen;
+    }
+    else {
+	read_text_trace(trace, path);
+	trace->trace_bytes = trace->num_ops * sizeof(traceop_t);
+    }
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in read_trace");
+
+    if (verbose > 1) {
+	getrusage(RUSAGE_SELF, &ru);
+	printf("Loaded %d ops in %.3f secs: %.0f KB of %s requests, "
+	       "%.0f KB of block arrays, max RSS %ld KB\n",
+	       trace->num_ops, wall_secs() - start,
+	       trace->trace_bytes / 1024.0,
+	       trace->bin ? "mapped" : "heap",
+	       trace->num_ids * (sizeof(char *) + sizeof(size_t)) / 1024.0,
+	       ru.ru_maxrss);
+    }
+    return trace;
+}
+
+/*
+ * read_text_trace - parse a text (.rep) trace into trace->ops
+ */
+static void read_text_trace(trace_t *trace, char *path)
+{
+    FILE *tracefile;
+    char type[MAXLINE];
+    unsigned index, size;
+    unsigned max_index = 0;
+    unsigned op_index;
+
+    /* Read the trace file header */
     if ((tracefile = fopen(path, "r")) == NULL) {
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
@@ -505,16 +742,6 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
 	unix_error("malloc 2 failed in read_trace");
 
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
@@ -550,8 +777,6 @@ static trace_t *read_trace(char *tracedir, char *filename)
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
-    
-    return trace;
 }
 
 /*
@@ -563,9 +788,319 @@ void free_trace(trace_t *trace)
     free(trace->ops);         /* free the three arrays... */
     free(trace->blocks);      
     free(trace->block_sizes);
+    if (trace->bin) {         /* ...unmap a binary trace... */
+	btrace_close(trace->bin);
+	free(trace->bin);
+    }
     free(trace);              /* and the trace record itself... */
 }
 
+/*
+ * trace_rewind - Start walking the requests of a trace from the top
+ */
+static void trace_rewind(trace_t *trace, tracecur_t *cur)
+{
+    cur->opnum = 0;
+    if (trace->bin)
+	btrace_rewind(trace->bin, &cur->bcur);
+}
+
+/*
+ * trace_next - Return the next request of a trace, or NULL when the
+ *     trace is exhausted. The request number is cur->opnum - 1.
+ */
+static inline traceop_t *trace_next(trace_t *trace, tracecur_t *cur)
+{
+    btrace_op_t bop;
+    int rc;
+
+    if (cur->opnum >= trace->num_ops)
+	return NULL;
+    if (trace->bin == NULL)
+	return &trace->ops[cur->opnum++];
+
+    if ((rc = btrace_next(trace->bin, &cur->bcur, &bop)) < 0)
+	app_error("Malformed request in binary trace");
+    if (rc == 0)
+	app_error("Binary trace ended early");
+    if (bop.index < 0 || bop.index >= trace->num_ids)
+	app_error("Bogus block index in binary trace");
+    cur->op.type = bop.type;
+    cur->op.index = bop.index;
+    cur->op.size = bop.size;
+    cur->opnum++;
+    return &cur->op;
+}
+
+/**********************************************************************
+ * The following functions load allocator backends and run the package
+ * under test over a whole set of traces.
+ **********************************************************************/
+
+/*
+ * load_backend - Find an allocator for -b. "libc" names the system
+ *     allocator; anything else is a shared object that exports an 
+ *     mm_ops_t called mm_backend. Bare file names are looked up in
+ *     the current directory rather than the library path.
+ */
+static mm_ops_t *load_backend(char *path)
+{
+    char file[MAXLINE];
+    void *handle;
+    mm_ops_t *ops;
+
+    if (!strcmp(path, "libc"))
+	return &libc_backend;
+    if (strchr(path, '/') == NULL)
+	snprintf(file, MAXLINE, "./%s", path);
+    else
+	snprintf(file, MAXLINE, "%s", path);
+
+    if ((handle = dlopen(file, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	printf("ERROR: Could not load backend: %s\n", dlerror());
+	exit(1);
+    }
+    if ((ops = (mm_ops_t *)dlsym(handle, MM_BACKEND_SYM)) == NULL) {
+	printf("ERROR: Backend %s does not export %s\n", file, MM_BACKEND_SYM);
+	exit(1);
+    }
+    return ops;
+}
+
+/*
+ * eval_backend - Check the package under test (mm) on each trace and,
+ *     for those it gets right, measure its utilization and throughput
+ *     and add its per-op latencies to lat, unless lat is NULL
+ */
+static void eval_backend(char **tracefiles, int n, stats_t *stats,
+			 latency_t *lat)
+{
+    int i;
+    range_t *ranges = NULL;
+
+    if (jobs > 1 && n > 1) {
+	eval_parallel(tracefiles, n, stats, lat);
+	return;
+    }
+    for (i=0; i < n; i++)
+	eval_trace(tracefiles[i], i, &stats[i], lat, &ranges);
+    clear_ranges(&ranges);
+}
+
+/*
+ * eval_trace - Run every pass of the package under test on one trace
+ */
+static void eval_trace(char *tracefile, int tracenum, stats_t *stats,
+		       latency_t *lat, range_t **ranges)
+{
+    trace_t *trace;
+    speed_t speed_params;
+
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking %s_malloc for correctness, ", mm->name);
+    stats->valid = eval_mm_valid(trace, tracenum, ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	if (mm->uses_memlib)
+	    eval_mm_util(trace, tracenum, ranges, stats);
+	speed_params.trace = trace;
+	speed_params.ranges = *ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	if (lat != NULL)
+	    eval_mm_latency(trace, lat);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_parallel - eval_backend for -j. Each trace runs in a worker
+ *     process of its own, pinned to one of the chosen cores, with its
+ *     own copy of the simulated heap, and at most one worker per core.
+ *     Workers leave their results in shared memory for the parent to
+ *     merge. A worker that dies marks its trace invalid.
+ */
+static void eval_parallel(char **tracefiles, int n, stats_t *stats,
+			  latency_t *lat)
+{
+    result_t *res;
+    pid_t pid, busy[MAXCORES];
+    int slot[MAXCORES];   /* trace each busy core is running */
+    int i, s, t, c, status, next = 0, running = 0;
+    int nslots = (num_cores > 0) ? num_cores : jobs;
+    range_t *ranges = NULL;
+
+    res = mmap(NULL, n * sizeof(result_t), PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (res == MAP_FAILED)
+	unix_error("mmap failed in eval_parallel");
+    memset(busy, 0, sizeof(busy));
+
+    /* Don't let the workers inherit (and repeat) buffered output */
+    fflush(stdout);
+
+    while (next < n || running > 0) {
+	/* Start a worker on every idle core */
+	for (s = 0; s < nslots && next < n; s++) {
+	    if (busy[s] != 0)
+		continue;
+	    if ((pid = fork()) < 0)
+		unix_error("fork failed in eval_parallel");
+	    if (pid == 0) {
+		if (num_cores > 0)
+		    pin_to_core(cores[s]);
+		set_fsecs_workers(nslots);
+		errors = 0;
+		eval_trace(tracefiles[next], next, &res[next].stats, 
+			   (lat != NULL) ? &res[next].lat : NULL, &ranges);
+		res[next].errors = errors;
+		fflush(stdout);
+		_exit(0);
+	    }
+	    busy[s] = pid;
+	    slot[s] = next++;
+	    running++;
+	}
+
+	/* Wait for one to finish */
+	if ((pid = wait(&status)) < 0)
+	    unix_error("wait failed in eval_parallel");
+	for (s = 0; s < nslots && busy[s] != pid; s++)
+	    ;
+	if (s == nslots)
+	    continue;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	    printf("ERROR [trace %d]: worker exited abnormally\n", slot[s]);
+	    res[slot[s]].stats.valid = 0;
+	    res[slot[s]].errors++;
+	}
+	busy[s] = 0;
+	running--;
+    }
+
+    /* Merge the workers' results */
+    for (i=0; i < n; i++) {
+	stats[i] = res[i].stats;
+	errors += res[i].errors;
+	if (lat != NULL)
+	    for (t = 0; t < 3; t++)
+		for (c = 0; c < NUM_SIZECLASSES; c++)
+		    hist_merge(&lat->hist[t][c], &res[i].lat.hist[t][c]);
+    }
+    munmap(res, n * sizeof(result_t));
+}
+
+/*
+ * parse_cpulist - Read a list of cores such as "0,2,8-15" into set.
+ *     Returns the number of cores, or -1 if the list is malformed.
+ */
+static int parse_cpulist(char *list, cpu_set_t *set)
+{
+    char *p = list, *end;
+    long lo, hi;
+
+    CPU_ZERO(set);
+    while (*p != '\0' && *p != '\n') {
+	lo = hi = strtol(p, &end, 10);
+	if (end == p || lo < 0)
+	    return -1;
+	p = end;
+	if (*p == '-') {
+	    hi = strtol(p+1, &end, 10);
+	    if (end == p+1 || hi < lo)
+		return -1;
+	    p = end;
+	}
+	for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+	    CPU_SET(lo, set);
+	if (*p == ',')
+	    p++;
+	else if (*p != '\0' && *p != '\n')
+	    return -1;
+    }
+    return CPU_COUNT(set);
+}
+
+/*
+ * pick_cores - Choose the cores for the -j workers: those named by -C,
+ *     else one hardware thread per physical core among the cores this
+ *     process may run on, so that no two workers share a core's private
+ *     caches. Lowers jobs to the number of cores found; with no core
+ *     information at all, the workers run unpinned.
+ */
+static void pick_cores(char *list)
+{
+    cpu_set_t allowed, asked, siblings;
+    char path[MAXLINE], buf[MAXLINE];
+    FILE *fp;
+    int cpu, sib, shared;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+	return;
+    if (list != NULL) {
+	if (parse_cpulist(list, &asked) <= 0)
+	    app_error("Bad core list for -C");
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	    if (CPU_ISSET(cpu, &asked) && !CPU_ISSET(cpu, &allowed)) {
+		printf("Core %d is not available; not using it\n", cpu);
+		CPU_CLR(cpu, &asked);
+	    }
+	if (CPU_COUNT(&asked) == 0)
+	    app_error("None of the -C cores are available");
+	allowed = asked;
+    }
+
+    for (cpu = 0; cpu < CPU_SETSIZE && num_cores < jobs; cpu++) {
+	if (!CPU_ISSET(cpu, &allowed))
+	    continue;
+
+	/* Skip SMT siblings of a core we already took (unless asked for) */
+	shared = 0;
+	sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/"
+		"thread_siblings_list", cpu);
+	if (list == NULL && (fp = fopen(path, "r")) != NULL) {
+	    if (fgets(buf, MAXLINE, fp) != NULL && 
+		parse_cpulist(buf, &siblings) > 0)
+		for (sib = 0; sib < cpu; sib++)
+		    if (CPU_ISSET(sib, &siblings) && CPU_ISSET(sib, &allowed))
+			shared = 1;
+	    fclose(fp);
+	}
+	if (!shared && num_cores < MAXCORES)
+	    cores[num_cores++] = cpu;
+    }
+
+    if (num_cores > 0 && num_cores < jobs) {
+	if (list == NULL)
+	    printf("Only %d cores available; running %d traces at once\n",
+		   num_cores, num_cores);
+	jobs = num_cores;
+    }
+    if (verbose && num_cores > 0) {
+	printf("Running traces on cores");
+	for (cpu = 0; cpu < num_cores; cpu++)
+	    printf(" %d", cores[cpu]);
+	printf("\n");
+    }
+}
+
+/*
+ * pin_to_core - Keep the calling process on one core
+ */
+static void pin_to_core(int core)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+	unix_error("sched_setaffinity failed");
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -583,28 +1118,31 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *newp;
     char *oldp;
     char *p;
+    tracecur_t cur;
+    traceop_t *op;
     
-    /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
+    /* Free any records in the range list */
     clear_ranges(ranges);
 
-    /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    /* Reset the heap and call the mm package's init function */
+    if (mm_start() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
 
     /* Interpret each operation in the trace in order */
-    for (i = 0;  i < trace->num_ops;  i++) {
-	index = trace->ops[i].index;
-	size = trace->ops[i].size;
+    trace_rewind(trace, &cur);
+    while ((op = trace_next(trace, &cur)) != NULL) {
+	i = cur.opnum - 1;
+	index = op->index;
+	size = op->size;
 
-        switch (trace->ops[i].type) {
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = mm->malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -633,7 +1171,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -653,7 +1191,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -671,7 +1209,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm->free(p);
 	    break;
 
 	default:
@@ -689,36 +1227,45 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   high water mark of the brk while running the student's malloc 
+ *   package on the trace. 
+ *
+ *   With the mmap memory model we also compute hwm over the peak 
+ *   number of heap bytes actually resident, which credits allocators 
+ *   that shrink the heap or decommit free pages, and count the page 
+ *   faults taken along the way. Every payload is touched as it is
+ *   handed out, as a program would, so that residency counts the
+ *   blocks and not just the allocator's own metadata.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static void eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			 stats_t *stats)
 {   
-    int i;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    size_t resident;
+    tracecur_t cur;
+    traceop_t *op;
 
-    /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
-    if (mm_init() < 0)
+    /* initialize a cold heap and the mm malloc package */
+    mem_set_accounting(1);
+    if (mm_start() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    trace_rewind(trace, &cur);
+    while ((op = trace_next(trace, &cur)) != NULL) {
+        switch (op->type) {
 
         case ALLOC: /* mm_alloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+	    index = op->index;
+	    size = op->size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm->malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
+	    touch_payload(p, size);
 	    
 	    /* Remember region and size */
 	    trace->blocks[index] = p;
@@ -734,13 +1281,14 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
+	    index = op->index;
+	    newsize = op->size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
+	    touch_payload(newp, newsize);
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -756,11 +1304,11 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case FREE: /* mm_free */
-	    index = trace->ops[i].index;
+	    index = op->index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -774,50 +1322,73 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    stats->util = (double)max_total_size / (double)mem_peak_heapsize();
+    /* 0 if no heap page was ever resident */
+    resident = mem_peak_resident();
+    stats->rss_util = resident ? (double)max_total_size / (double)resident : 0;
+    stats->faults = mem_minor_faults();
+    mem_set_accounting(0);
 }
 
 
+/*
+ * touch_payload - Write a byte in every page of a payload so that all
+ *     of it is resident
+ */
+static void touch_payload(char *p, int size)
+{
+    size_t page = mem_pagesize();
+    size_t i;
+
+    if (size <= 0)
+	return;
+    for (i = 0; i < (size_t)size; i += page)
+	p[i] = 0x5a;
+    p[size - 1] = 0x5a;
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    tracecur_t cur;
+    traceop_t *op;
 
     /* Reset the heap and initialize the mm package */
-    mem_reset_brk();
-    if (mm_init() < 0) 
+    if (mm_start() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+    trace_rewind(trace, &cur);
+    while ((op = trace_next(trace, &cur)) != NULL)
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            index = op->index;
+            size = op->size;
+            if ((p = mm->malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
+	    index = op->index;
+            newsize = op->size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
+            index = op->index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm->free(block);
             break;
 
 	default:
@@ -825,6 +1396,25 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * mm_start - Give the package under test an empty heap and initialize it
+ */
+static int mm_start(void)
+{
+    mem_reset_brk();
+    if (mm->reset != NULL)
+	mm->reset();
+    return mm->init();
+}
+
+/*
+ * libc_init - The system allocator needs no initialization
+ */
+static int libc_init(void)
+{
+    return 0;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -835,30 +1425,34 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 {
     int i, newsize;
     char *p, *newp, *oldp;
+    tracecur_t cur;
+    traceop_t *op;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    trace_rewind(trace, &cur);
+    while ((op = trace_next(trace, &cur)) != NULL) {
+	i = cur.opnum - 1;
+        switch (op->type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+	    if ((p = malloc(op->size)) == NULL) {
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = p;
+	    trace->blocks[op->index] = p;
 	    break;
 
 	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
+            newsize = op->size;
+	    oldp = trace->blocks[op->index];
 	    if ((newp = realloc(oldp, newsize)) == NULL) {
 		malloc_error(tracenum, i, "libc realloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = newp;
+	    trace->blocks[op->index] = newp;
 	    break;
 	    
         case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
+	    free(trace->blocks[op->index]);
 	    break;
 
 	default:
@@ -876,24 +1470,26 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    tracecur_t cur;
+    traceop_t *op;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    trace_rewind(trace, &cur);
+    while ((op = trace_next(trace, &cur)) != NULL) {
+        switch (op->type) {
         case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+	    index = op->index;
+	    size = op->size;
 	    if ((p = malloc(size)) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
 	    trace->blocks[index] = p;
 	    break;
 
 	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
+	    index = op->index;
+	    newsize = op->size;
 	    oldp = trace->blocks[index];
 	    if ((newp = realloc(oldp, newsize)) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
@@ -902,7 +1498,7 @@ static void eval_libc_speed(void *ptr)
 	    break;
 	    
         case FREE: /* free */
-	    index = trace->ops[i].index;
+	    index = op->index;
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
@@ -910,6 +1506,169 @@ static void eval_libc_speed(void *ptr)
     }
 }
 
+/**********************************************************************
+ * The following functions time every request of a trace on its own and
+ * record the results in per-op latency histograms. This is a separate
+ * pass from the fsecs() timing so that the per-op clock reads never
+ * inflate the throughput numbers.
+ **********************************************************************/
+
+/*
+ * op_clock - Read the per-op clock, in ns
+ */
+static inline uint64_t op_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * calibrate_op_clock - Estimate the cost of an empty op_clock() pair
+ *     as the median of many back-to-back reads.
+ */
+static void calibrate_op_clock(void)
+{
+    hist_t h;
+    uint64_t t0, t1;
+    int i;
+
+    hist_reset(&h);
+    for (i = 0; i < 100000; i++) {
+	t0 = op_clock();
+	t1 = op_clock();
+	hist_record(&h, t1 - t0);
+    }
+    op_clock_ovhd = hist_percentile(&h, 50.0);
+    if (verbose)
+	printf("Per-op clock overhead is %llu ns.\n",
+	       (unsigned long long)op_clock_ovhd);
+}
+
+/*
+ * record_latency - Add one request's time, less the clock overhead, to
+ *     the histogram for its type and size class
+ */
+static inline void record_latency(latency_t *lat, int type, int size,
+				  uint64_t start, uint64_t end)
+{
+    uint64_t ns = end - start;
+    int c = 0;
+
+    while (c < NUM_SIZECLASSES-1 && size > sizeclass_max[c])
+	c++;
+    hist_record(&lat->hist[type][c], 
+		(ns > op_clock_ovhd) ? ns - op_clock_ovhd : 0);
+}
+
+/*
+ * eval_mm_latency - Time each request of the mm malloc package
+ */
+static void eval_mm_latency(trace_t *trace, latency_t *lat)
+{
+    int index, size;
+    char *p;
+    uint64_t t0, t1;
+    tracecur_t cur;
+    traceop_t *op;
+
+    if (mm_start() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    trace_rewind(trace, &cur);
+    while ((op = trace_next(trace, &cur)) != NULL) {
+	index = op->index;
+	switch (op->type) {
+
+	case ALLOC: /* mm_malloc */
+	    size = op->size;
+	    t0 = op_clock();
+	    p = mm->malloc(size);
+	    t1 = op_clock();
+	    if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    size = op->size;
+	    t0 = op_clock();
+	    p = mm->realloc(trace->blocks[index], size);
+	    t1 = op_clock();
+	    if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+	    break;
+
+	case FREE: /* mm_free */
+	    size = trace->block_sizes[index];
+	    p = trace->blocks[index];
+	    t0 = op_clock();
+	    mm->free(p);
+	    t1 = op_clock();
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+	    return;
+	}
+	trace->blocks[index] = p;
+	trace->block_sizes[index] = size;
+	record_latency(lat, op->type, size, t0, t1);
+    }
+}
+
+/*
+ * eval_libc_latency - Time each request of the libc malloc package
+ */
+static void eval_libc_latency(trace_t *trace, latency_t *lat)
+{
+    int index, size;
+    char *p;
+    uint64_t t0, t1;
+    tracecur_t cur;
+    traceop_t *op;
+
+    trace_rewind(trace, &cur);
+    while ((op = trace_next(trace, &cur)) != NULL) {
+	index = op->index;
+	switch (op->type) {
+
+	case ALLOC: /* malloc */
+	    size = op->size;
+	    t0 = op_clock();
+	    p = malloc(size);
+	    t1 = op_clock();
+	    if (p == NULL)
+		unix_error("malloc failed in eval_libc_latency");
+	    break;
+
+	case REALLOC: /* realloc */
+	    size = op->size;
+	    t0 = op_clock();
+	    p = realloc(trace->blocks[index], size);
+	    t1 = op_clock();
+	    if (p == NULL)
+		unix_error("realloc failed in eval_libc_latency");
+	    break;
+
+	case FREE: /* free */
+	    size = trace->block_sizes[index];
+	    p = trace->blocks[index];
+	    t0 = op_clock();
+	    free(p);
+	    t1 = op_clock();
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_libc_latency");
+	    return;
+	}
+	trace->blocks[index] = p;
+	trace->block_sizes[index] = size;
+	record_latency(lat, op->type, size, t0, t1);
+    }
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -924,52 +1683,185 @@ static void printresults(int n, stats_t *stats)
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double rss_util = 0;
+    double faults = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
+    printf("%5s%7s %5s%8s%10s%6s", 
 	   "trace", " valid", "util", "ops", "secs", "Kops");
+#if MEM_USE_MMAP
+    printf("%7s%8s", "rss", "faults");
+#endif
+    printf("\n");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
+#if MEM_USE_MMAP
+	    printf("%6.0f%%%8.0f", stats[i].rss_util*100.0, stats[i].faults);
+#endif
+	    printf("\n");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
+	    rss_util += stats[i].rss_util;
+	    faults += stats[i].faults;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%6s", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
 		   "-");
+#if MEM_USE_MMAP
+	    printf("%7s%8s", "-", "-");
+#endif
+	    printf("\n");
 	}
     }
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%8.0f%10.6f%6.0f", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       ops, 
 	       secs,
 	       (ops/1e3)/secs);
+#if MEM_USE_MMAP
+	printf("%6.0f%%%8.0f", (rss_util/n)*100.0, faults);
+#endif
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%8s%10s%6s", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
 	       "-");
+#if MEM_USE_MMAP
+	printf("%7s%8s", "-", "-");
+#endif
     }
+    printf("\n");
+
+}
+
+/*
+ * printcompare - prints one row of the backend comparison: how many
+ *     traces some malloc package got right and, over those traces, its
+ *     average utilization, overall throughput and per-op latency 
+ *     percentiles across all request types
+ */
+static void printcompare(char *name, int n, stats_t *stats, latency_t *lat,
+			 int has_util)
+{
+    char valid[16];
+    double secs = 0, ops = 0, util = 0, rss_util = 0;
+    int i, t, c, nvalid = 0;
+    hist_t all;
 
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    nvalid++;
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	    rss_util += stats[i].rss_util;
+	}
+    }
+    hist_reset(&all);
+    for (t = 0; t < 3; t++)
+	for (c = 0; c < NUM_SIZECLASSES; c++)
+	    hist_merge(&all, &lat->hist[t][c]);
+
+    sprintf(valid, "%d/%d", nvalid, n);
+    printf("%-16s%6s", name, valid);
+    if (nvalid == 0) {
+	printf("%6s", "-");
+#if MEM_USE_MMAP
+	printf("%6s", "-");
+#endif
+	printf("%8s%8s%8s%8s\n", "-", "-", "-", "-");
+	return;
+    }
+    if (has_util)
+	printf("%5.0f%%", util/nvalid*100.0);
+    else
+	printf("%6s", "-");
+#if MEM_USE_MMAP
+    if (has_util)
+	printf("%5.0f%%", rss_util/nvalid*100.0);
+    else
+	printf("%6s", "-");
+#endif
+    printf("%8.0f%8llu%8llu%8llu\n", 
+	   (ops/1e3)/secs,
+	   (unsigned long long)hist_percentile(&all, 50.0),
+	   (unsigned long long)hist_percentile(&all, 99.0),
+	   (unsigned long long)hist_percentile(&all, 99.9));
+}
+
+/*
+ * wall_secs - Current wall-clock time in seconds
+ */
+static double wall_secs(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * printlatency - prints the per-op latency percentiles of some malloc
+ *     package, one row per request type and size class plus a total
+ *     row per request type
+ */
+static void printlatency(latency_t *lat)
+{
+    static char *opname[3] = {"alloc", "free", "realloc"};
+    char label[32];
+    hist_t all;
+    hist_t *h;
+    int t, c;
+
+    printf("%8s%9s%10s%8s%8s%8s%9s  (ns, %llu ns clock overhead removed)\n",
+	   "op", "size", "count", "p50", "p99", "p99.9", "max",
+	   (unsigned long long)op_clock_ovhd);
+    for (t = 0; t < 3; t++) {
+	hist_reset(&all);
+	for (c = 0; c <= NUM_SIZECLASSES; c++) {
+	    if (c < NUM_SIZECLASSES) {
+		h = &lat->hist[t][c];
+		hist_merge(&all, h);
+		if (c < NUM_SIZECLASSES-1)
+		    sprintf(label, "<=%d", sizeclass_max[c]);
+		else
+		    sprintf(label, ">%d", sizeclass_max[c-1]);
+	    }
+	    else {
+		h = &all;
+		strcpy(label, "all");
+	    }
+	    if (h->total == 0)
+		continue;
+	    printf("%8s%9s%10llu%8llu%8llu%8llu%9llu\n",
+		   opname[t], label,
+		   (unsigned long long)h->total,
+		   (unsigned long long)hist_percentile(h, 50.0),
+		   (unsigned long long)hist_percentile(h, 99.0),
+		   (unsigned long long)hist_percentile(h, 99.9),
+		   (unsigned long long)h->max);
+	}
+    }
 }
 
 /* 
@@ -1004,13 +1896,19 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValL] [-f <file>] [-t <dir>] [-b <so>]...\n"
+	    "               [-j <n>] [-C <cores>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-b <so>    Also run and compare the allocator in <so>\n");
+    fprintf(stderr, "\t           (or the system allocator for \"libc\").\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-C <cores> Run -j workers only on these cores (e.g. 2,4-7).\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate up to <n> traces at once, one per core.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Report per-op latency percentiles.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
@@ -2,12 +2,26 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * There are two models, selected by MEM_USE_MMAP in config.h:
+ *
+ *   malloc  The heap is a MAX_HEAP byte array from malloc and mem_sbrk
+ *           just moves a pointer through it. The heap cannot shrink.
+ *
+ *   mmap    The heap is a MEM_RESERVE byte range of address space mapped
+ *           PROT_NONE. mem_sbrk commits pages as the brk grows and
+ *           decommits them when it shrinks, and mem_decommit lets an
+ *           allocator hand back whole free pages inside the heap. Since
+ *           only committed pages can be touched, the module can report
+ *           how much of the heap is really resident (via mincore) and
+ *           how many page faults touching it cost.
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <string.h>
 #include <errno.h>
 
@@ -18,12 +32,41 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_peak_brk;   /* high water mark of mem_brk since reset */
+
+#if MEM_USE_MMAP
+static char *mem_commit_brk;     /* end of the committed (RW) pages */
+static size_t mem_page;          /* page size */
+static int mem_accounting = 0;   /* sample residency on decommit? */
+static size_t mem_peak_rss;      /* largest sampled resident size */
+static long mem_base_faults;     /* minor faults at last reset */
+static unsigned char *mem_vec;   /* mincore result buffer */
+static size_t mem_vec_len;
+
+static void decommit_range(char *lo, char *hi);
+static size_t resident_bytes(char *lo, char *hi);
+static long minor_faults(void);
+#endif
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
+#if MEM_USE_MMAP
+    /* reserve address space only; pages are committed by mem_sbrk */
+    mem_page = (size_t)getpagesize();
+    mem_start_brk = mmap(NULL, MEM_RESERVE, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
+	exit(1);
+    }
+    mem_max_addr = mem_start_brk + MEM_RESERVE;  /* max legal heap address */
+    mem_commit_brk = mem_start_brk;
+    mem_peak_rss = 0;
+    mem_base_faults = minor_faults();
+#else
     /* allocate the storage we will use to model the available VM */
     if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
 	fprintf(stderr, "mem_init_vm: malloc error\n");
@@ -31,7 +74,9 @@ void mem_init(void)
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+#endif
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak_brk = mem_start_brk;
 }
 
 /* 
@@ -39,35 +84,104 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
+#if MEM_USE_MMAP
+    munmap(mem_start_brk, MEM_RESERVE);
+    free(mem_vec);
+    mem_vec = NULL;
+    mem_vec_len = 0;
+#else
     free(mem_start_brk);
+#endif
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    In the mmap model with accounting on, every page is also given
+ *    back so that residency and faults are measured from a cold heap.
+ *    Otherwise the committed pages stay warm, as in the malloc model,
+ *    so that timing runs do not pay for faulting the heap in again.
  */
 void mem_reset_brk()
 {
+#if MEM_USE_MMAP
+    if (mem_accounting) {
+	decommit_range(mem_start_brk, mem_commit_brk);
+	mem_commit_brk = mem_start_brk;
+    }
+    mem_peak_rss = 0;
+    mem_base_faults = minor_faults();
+#endif
     mem_brk = mem_start_brk;
+    mem_peak_brk = mem_start_brk;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
  *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    the malloc model, the heap cannot be shrunk. In the mmap model a
+ *    negative incr shrinks the heap and decommits the pages above the
+ *    new brk.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
+#if MEM_USE_MMAP
+    char *new_commit;
+
+    if ((mem_brk + incr) > mem_max_addr || (mem_brk + incr) < mem_start_brk) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    new_commit = mem_start_brk +
+	(((size_t)(mem_brk + incr - mem_start_brk) + mem_page - 1) &
+	 ~(mem_page - 1));
+    if (new_commit > mem_commit_brk) {
+	if (mprotect(mem_commit_brk, new_commit - mem_commit_brk,
+		     PROT_READ | PROT_WRITE) < 0) {
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit pages...\n");
+	    return (void *)-1;
+	}
+	mem_commit_brk = new_commit;
+    }
+    else if (incr < 0 && new_commit < mem_commit_brk) {
+	decommit_range(new_commit, mem_commit_brk);
+	mem_commit_brk = new_commit;
+    }
+#else
     if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
+#endif
     mem_brk += incr;
+    if (mem_brk > mem_peak_brk)
+	mem_peak_brk = mem_brk;
     return (void *)old_brk;
 }
 
+/*
+ * mem_decommit - tell the memory system that the bytes in [addr,
+ *    addr+len) are free. Every whole page in that range is released
+ *    and reads back as zeros the next time it is touched. A no-op in
+ *    the malloc model.
+ */
+void mem_decommit(void *addr, size_t len)
+{
+#if MEM_USE_MMAP
+    char *lo = (char *)(((size_t)addr + mem_page - 1) & ~(mem_page - 1));
+    char *hi = (char *)(((size_t)addr + len) & ~(mem_page - 1));
+
+    if (lo < mem_start_brk || hi > mem_commit_brk || lo >= hi)
+	return;
+    if (mem_accounting)
+	mem_peak_resident();
+    madvise(lo, hi - lo, MADV_DONTNEED);
+#endif
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -92,6 +206,15 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *    the last mem_reset_brk
+ */
+size_t mem_peak_heapsize()
+{
+    return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -99,3 +222,112 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_set_accounting - When set, the mmap model samples the resident
+ *    size before every decommit so that mem_peak_resident is exact.
+ *    Sampling costs a mincore call, so leave it off while timing.
+ */
+void mem_set_accounting(int on)
+{
+#if MEM_USE_MMAP
+    mem_accounting = on;
+#endif
+}
+
+/*
+ * mem_resident() - returns the number of heap bytes resident in memory
+ */
+size_t mem_resident()
+{
+#if MEM_USE_MMAP
+    return resident_bytes(mem_start_brk, mem_commit_brk);
+#else
+    return mem_heapsize();
+#endif
+}
+
+/*
+ * mem_peak_resident() - returns the largest resident heap size seen
+ *    since the last mem_reset_brk. Pages only leave the heap through
+ *    decommits, so with accounting on this is the true peak.
+ */
+size_t mem_peak_resident()
+{
+#if MEM_USE_MMAP
+    size_t rss = mem_resident();
+
+    if (rss > mem_peak_rss)
+	mem_peak_rss = rss;
+    return mem_peak_rss;
+#else
+    return mem_peak_heapsize();
+#endif
+}
+
+/*
+ * mem_minor_faults() - returns the number of minor page faults taken by
+ *    the process since the last mem_reset_brk. This counts faults from
+ *    outside the heap too, but the driver does little else between
+ *    resets.
+ */
+long mem_minor_faults()
+{
+#if MEM_USE_MMAP
+    return minor_faults() - mem_base_faults;
+#else
+    return 0;
+#endif
+}
+
+#if MEM_USE_MMAP
+/*
+ * decommit_range - release the pages in [lo,hi) and make them
+ *    inaccessible again
+ */
+static void decommit_range(char *lo, char *hi)
+{
+    if (lo >= hi)
+	return;
+    if (mem_accounting)
+	mem_peak_resident();
+    madvise(lo, hi - lo, MADV_DONTNEED);
+    mprotect(lo, hi - lo, PROT_NONE);
+}
+
+/*
+ * resident_bytes - count the resident pages in [lo,hi)
+ */
+static size_t resident_bytes(char *lo, char *hi)
+{
+    size_t npages = (hi - lo) / mem_page;
+    size_t i, n = 0;
+
+    if (npages == 0)
+	return 0;
+    if (npages > mem_vec_len) {
+	free(mem_vec);
+	if ((mem_vec = malloc(npages)) == NULL) {
+	    fprintf(stderr, "mem_resident: malloc error\n");
+	    exit(1);
+	}
+	mem_vec_len = npages;
+    }
+    if (mincore(lo, hi - lo, (void *)mem_vec) < 0)
+	return 0;
+    for (i = 0; i < npages; i++)
+	n += mem_vec[i] & 1;
+    return n * mem_page;
+}
+
+/*
+ * minor_faults - the process's minor page fault count
+ */
+static long minor_faults(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+#endif
@@ -4,8 +4,15 @@ void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
+void mem_decommit(void *addr, size_t len);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
+/* Residency and fault accounting (meaningful with MEM_USE_MMAP only) */
+void mem_set_accounting(int on);
+size_t mem_resident(void);
+size_t mem_peak_resident(void);
+long mem_minor_faults(void);
@@ -5,6 +5,28 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * An allocator the driver can run, as a table of its entry points.
+ * The built-in table wraps the functions above; others are loaded
+ * from shared objects (mdriver -b) that export one of these under
+ * the name mm_backend. The driver calls reset, if there is one, and
+ * then init before every pass over a trace, so init must forget all
+ * earlier state. Backends that get their heap from mem_sbrk set
+ * uses_memlib, and only those are checked against the heap extent
+ * and scored on utilization.
+ */
+typedef struct {
+    char *name;                            /* label in the results */
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*reset)(void);                   /* may be NULL */
+    int uses_memlib;                       /* heap comes from mem_sbrk */
+} mm_ops_t;
+
+#define MM_BACKEND_SYM "mm_backend"
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
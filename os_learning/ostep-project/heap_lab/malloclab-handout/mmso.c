@@ -0,0 +1,20 @@
+/*
+ * mmso.c - Exports an mm.c-style malloc package as an mdriver backend.
+ *
+ * Link it into a shared object together with the package, e.g.
+ *
+ *     unix> make mm-explicit.so
+ *     unix> mdriver -v -b ./mm-explicit.so
+ *
+ * MMSO_NAME, set by the Makefile, labels the package in the results.
+ */
+#include "mm.h"
+#include "memlib.h"
+
+#ifndef MMSO_NAME
+#define MMSO_NAME "mm"
+#endif
+
+mm_ops_t mm_backend = {
+    MMSO_NAME, mm_init, mm_malloc, mm_free, mm_realloc, NULL, 1
+};
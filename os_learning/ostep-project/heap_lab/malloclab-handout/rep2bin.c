@@ -0,0 +1,85 @@
+/*
+ * rep2bin.c - Convert a text (.rep) trace into the binary format
+ *     described in btrace.h, which mdriver can map and stream.
+ *
+ * usage: rep2bin <in.rep> <out.bin>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "btrace.h"
+
+int main(int argc, char **argv)
+{
+    FILE *in;
+    btrace_writer_t w;
+    char type[16];
+    int sugg_heapsize, num_ids, num_ops, weight;
+    unsigned index, size;
+    int ops = 0;
+
+    if (argc != 3) {
+	fprintf(stderr, "usage: %s <in.rep> <out.bin>\n", argv[0]);
+	exit(1);
+    }
+    if ((in = fopen(argv[1], "r")) == NULL) {
+	fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+	exit(1);
+    }
+    if (fscanf(in, "%d %d %d %d", &sugg_heapsize, &num_ids,
+	       &num_ops, &weight) != 4) {
+	fprintf(stderr, "%s: malformed trace header\n", argv[1]);
+	exit(1);
+    }
+    if (btrace_writer_open(&w, argv[2], sugg_heapsize, weight) < 0) {
+	fprintf(stderr, "%s: %s\n", argv[2], strerror(errno));
+	exit(1);
+    }
+
+    while (fscanf(in, "%15s", type) == 1) {
+	int rc;
+
+	switch (type[0]) {
+	case 'a':
+	    if (fscanf(in, "%u %u", &index, &size) != 2)
+		goto bad;
+	    rc = btrace_writer_put(&w, BTRACE_ALLOC, index, size);
+	    break;
+	case 'r':
+	    if (fscanf(in, "%u %u", &index, &size) != 2)
+		goto bad;
+	    rc = btrace_writer_put(&w, BTRACE_REALLOC, index, size);
+	    break;
+	case 'f':
+	    if (fscanf(in, "%u", &index) != 1)
+		goto bad;
+	    rc = btrace_writer_put(&w, BTRACE_FREE, index, 0);
+	    break;
+	default:
+	    goto bad;
+	}
+	if (rc < 0) {
+	    fprintf(stderr, "%s: %s\n", argv[2], strerror(errno));
+	    exit(1);
+	}
+	ops++;
+    }
+    fclose(in);
+
+    if (btrace_writer_close(&w) < 0) {
+	fprintf(stderr, "%s: %s\n", argv[2], strerror(errno));
+	exit(1);
+    }
+    if (ops != num_ops || w.hdr.num_ids != num_ids)
+	fprintf(stderr, "warning: header says %d ops/%d ids, found %d/%d\n",
+		num_ops, num_ids, ops, w.hdr.num_ids);
+    printf("%s: %d ops, %d ids -> %s (%lu bytes of stream)\n",
+	   argv[1], ops, w.hdr.num_ids, argv[2], (unsigned long)w.offset);
+    return 0;
+
+ bad:
+    fprintf(stderr, "%s: malformed request %d (%s)\n", argv[1], ops, type);
+    exit(1);
+}
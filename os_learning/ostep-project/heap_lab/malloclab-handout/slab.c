@@ -0,0 +1,153 @@
+/*
+ * slab.c - A segregated-storage malloc package, built as an mdriver
+ *          backend (make slab.so; mdriver -b slab.so).
+ *
+ * Requests of up to SLAB_MAX bytes are rounded up to a power-of-two
+ * size class. Each class carves SLAB_CHUNK bytes of heap at a time into
+ * equal blocks and keeps its free blocks on a LIFO list, so malloc and
+ * free never search. Larger requests get a block of their own from
+ * mem_sbrk, and freed large blocks are reused first fit. Blocks are
+ * never split or coalesced, so the heap only grows: memory freed in
+ * one class cannot serve another.
+ *
+ * Every block starts with a one-word header that holds its capacity.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define ALIGNMENT   8
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+#define HDRSIZE     ALIGN(sizeof(size_t))  /* block header */
+#define MIN_SHIFT   4                      /* smallest class is 16 bytes */
+#define NUM_CLASSES 9                      /* 16, 32, ..., 4096 bytes */
+#define SLAB_MAX    (1 << (MIN_SHIFT + NUM_CLASSES - 1))
+#define SLAB_CHUNK  (1 << 16)              /* heap taken per class refill */
+
+/* Capacity of block bp, and the link field of a free block */
+#define CAP(bp)  (*(size_t *)((char *)(bp) - HDRSIZE))
+#define NEXT(bp) (*(void **)(bp))
+
+static void *free_lists[NUM_CLASSES];  /* free small blocks, by class */
+static void *large_list;               /* free large blocks */
+
+/*
+ * class_of - Smallest class whose blocks hold size bytes
+ */
+static int class_of(size_t size)
+{
+    int c = 0;
+
+    while (((size_t)1 << (MIN_SHIFT + c)) < size)
+	c++;
+    return c;
+}
+
+/*
+ * refill - Carve a new chunk of heap into free blocks of class c
+ */
+static int refill(int c)
+{
+    size_t cap = (size_t)1 << (MIN_SHIFT + c);
+    size_t stride = HDRSIZE + cap;
+    char *chunk, *bp;
+    size_t i, n = SLAB_CHUNK / stride;
+
+    if ((chunk = mem_sbrk(n * stride)) == (void *)-1)
+	return -1;
+    for (i = 0; i < n; i++) {
+	bp = chunk + i * stride + HDRSIZE;
+	CAP(bp) = cap;
+	NEXT(bp) = free_lists[c];
+	free_lists[c] = bp;
+    }
+    return 0;
+}
+
+/*
+ * slab_init - Forget all blocks; the driver has emptied the heap
+ */
+static int slab_init(void)
+{
+    memset(free_lists, 0, sizeof(free_lists));
+    large_list = NULL;
+    return 0;
+}
+
+/*
+ * slab_malloc - Pop a block off the size class list, or find or make
+ *     a large block
+ */
+static void *slab_malloc(size_t size)
+{
+    void **pp;
+    char *bp;
+    int c;
+
+    if (size <= SLAB_MAX) {
+	c = class_of(size);
+	if (free_lists[c] == NULL && refill(c) < 0)
+	    return NULL;
+	bp = free_lists[c];
+	free_lists[c] = NEXT(bp);
+	return bp;
+    }
+
+    for (pp = &large_list; *pp != NULL; pp = (void **)*pp) {
+	if (CAP(*pp) >= size) {
+	    bp = *pp;
+	    *pp = NEXT(bp);
+	    return bp;
+	}
+    }
+    if ((bp = mem_sbrk(HDRSIZE + ALIGN(size))) == (void *)-1)
+	return NULL;
+    bp += HDRSIZE;
+    CAP(bp) = ALIGN(size);
+    return bp;
+}
+
+/*
+ * slab_free - Push a block back on the list it came from
+ */
+static void slab_free(void *bp)
+{
+    size_t cap;
+
+    if (bp == NULL)
+	return;
+    cap = CAP(bp);
+    if (cap <= SLAB_MAX) {
+	NEXT(bp) = free_lists[class_of(cap)];
+	free_lists[class_of(cap)] = bp;
+    }
+    else {
+	NEXT(bp) = large_list;
+	large_list = bp;
+    }
+}
+
+/*
+ * slab_realloc - Keep the block if it is already big enough, else move
+ */
+static void *slab_realloc(void *ptr, size_t size)
+{
+    void *newptr;
+
+    if (ptr == NULL)
+	return slab_malloc(size);
+    if (size <= CAP(ptr))
+	return ptr;
+    if ((newptr = slab_malloc(size)) == NULL)
+	return NULL;
+    memcpy(newptr, ptr, CAP(ptr));
+    slab_free(ptr);
+    return newptr;
+}
+
+mm_ops_t mm_backend = {
+    "slab", slab_init, slab_malloc, slab_free, slab_realloc, NULL, 1
+};
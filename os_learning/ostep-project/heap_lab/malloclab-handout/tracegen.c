@@ -0,0 +1,629 @@
+/*
+ * tracegen.c - Generate synthetic allocator traces from a parameter file
+ *
+ * usage: tracegen [-n <ops>] [-s <seed>] <params> <out>
+ *
+ * Writes a text trace when <out> ends in ".rep" and a binary trace (see
+ * btrace.h) otherwise. The same parameter file and seed always produce
+ * the same trace. -n and -s override the ops and seed parameters.
+ *
+ * The parameter file holds one "key = value" pair per line; '#' starts
+ * a comment. Unset keys keep the defaults in the params table below.
+ *
+ *   seed            PRNG seed
+ *   ops             approximate number of requests (live blocks are
+ *                   freed at the end, which adds a few more)
+ *   max_live        cap on live payload bytes; the block with the next
+ *                   scheduled event is freed early to stay under it, and
+ *                   a block still in its realloc chain stops growing
+ *
+ *   size_dist       uniform | bimodal | powerlaw
+ *   size_min/max    range of the (first) size mode
+ *   size_alpha      power-law exponent for powerlaw sizes
+ *   size2_min/max   range of the second mode of a bimodal distribution
+ *   size2_frac      fraction of bimodal requests drawn from mode two
+ *
+ *   life_dist       fixed | uniform | powerlaw, in requests
+ *   life_min/max    range of block lifetimes
+ *   life_alpha      power-law exponent for powerlaw lifetimes
+ *
+ *   realloc_frac    fraction of blocks that grow through realloc chains
+ *   realloc_steps   reallocs per chain, spread over the block's life
+ *   realloc_growth  size factor applied at each realloc
+ *
+ *   phases          number of phases the trace is split into
+ *   phase_scale     size factor applied at each new phase
+ *   phase_free      fraction of live blocks freed at each phase change
+ *
+ *   handoff_frac    fraction of allocations made by a producer that
+ *                   hands blocks to a FIFO consumer
+ *   handoff_batch   blocks per producer burst
+ *   handoff_depth   bursts the consumer lags behind the producer
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "btrace.h"
+
+#define MAXLINE 1024
+
+/* Kinds of scheduled events */
+#define EV_GROW 0
+#define EV_FREE 1
+
+/* Distribution shapes */
+#define DIST_FIXED    0
+#define DIST_UNIFORM  1
+#define DIST_BIMODAL  2
+#define DIST_POWERLAW 3
+
+/* A future realloc or free of block id at request time */
+typedef struct {
+    uint64_t time;
+    int id;
+    int kind;
+} event_t;
+
+/* Everything we know about one block id */
+typedef struct {
+    int size;        /* current payload size */
+    int live;        /* allocated and not yet freed? */
+    int steps;       /* reallocs left in its growth chain */
+    int livepos;     /* position in the live array */
+    uint64_t born;   /* request time of the allocation */
+    uint64_t death;  /* request time of the scheduled free */
+} block_t;
+
+/* Generator parameters, as read from the parameter file */
+typedef struct {
+    uint64_t seed;
+    long ops;
+    long max_live;
+    int size_dist;
+    int size_min, size_max;
+    double size_alpha;
+    int size2_min, size2_max;
+    double size2_frac;
+    int life_dist;
+    int life_min, life_max;
+    double life_alpha;
+    double realloc_frac;
+    int realloc_steps;
+    double realloc_growth;
+    int phases;
+    double phase_scale;
+    double phase_free;
+    double handoff_frac;
+    int handoff_batch;
+    int handoff_depth;
+} params_t;
+
+/* The generator state */
+static params_t prm = {
+    1, 20000, 8 << 20,
+    DIST_UNIFORM, 1, 4096, 1.5, 0, 0, 0.0,
+    DIST_UNIFORM, 1, 2000, 1.5,
+    0.0, 4, 1.5,
+    1, 1.0, 0.0,
+    0.0, 32, 4
+};
+static uint64_t rng;
+
+static block_t *blocks = NULL;   /* indexed by block id */
+static int num_ids = 0, cap_ids = 0;
+static int *live = NULL;         /* ids of the live blocks */
+static int num_live = 0;
+static long live_bytes = 0, peak_bytes = 0;
+
+static event_t *heap = NULL;     /* min-heap of events by time */
+static int heap_len = 0, heap_cap = 0;
+
+static int *fifo = NULL;         /* handoff queue, oldest first */
+static int fifo_head = 0, fifo_len = 0, fifo_cap = 0;
+
+static uint64_t now = 0;         /* requests emitted so far */
+static double size_factor = 1.0; /* grows with phase_scale */
+
+/* Output state */
+static int text_out;
+static FILE *body;               /* text body, copied out after header */
+static btrace_writer_t bw;
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "tracegen: %s\n", msg);
+    exit(1);
+}
+
+static void *xrealloc(void *p, size_t bytes)
+{
+    if ((p = realloc(p, bytes)) == NULL)
+	app_error("out of memory");
+    return p;
+}
+
+/**************************
+ * Random number generation
+ **************************/
+
+/* splitmix64 - small, fast and identical on every platform */
+static uint64_t next_rand(void)
+{
+    uint64_t z = (rng += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform double in [0,1) */
+static double rand_unit(void)
+{
+    return (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Uniform integer in [lo,hi] */
+static long rand_range(long lo, long hi)
+{
+    if (hi <= lo)
+	return lo;
+    return lo + (long)(next_rand() % (uint64_t)(hi - lo + 1));
+}
+
+/* Bounded Pareto on [lo,hi]: small values common, large ones rare */
+static long rand_powerlaw(long lo, long hi, double alpha)
+{
+    double u = rand_unit();
+    double ratio = pow((double)lo / hi, alpha);
+
+    if (hi <= lo)
+	return lo;
+    return (long)(lo / pow(1.0 - u * (1.0 - ratio), 1.0 / alpha));
+}
+
+/*****************
+ * Parameter file
+ *****************/
+
+static int parse_dist(char *val)
+{
+    if (!strcmp(val, "fixed"))
+	return DIST_FIXED;
+    if (!strcmp(val, "uniform"))
+	return DIST_UNIFORM;
+    if (!strcmp(val, "bimodal"))
+	return DIST_BIMODAL;
+    if (!strcmp(val, "powerlaw"))
+	return DIST_POWERLAW;
+    fprintf(stderr, "tracegen: unknown distribution %s\n", val);
+    exit(1);
+}
+
+static void read_params(char *path)
+{
+    FILE *fp;
+    char line[MAXLINE], key[MAXLINE], val[MAXLINE];
+    char *hash;
+    int lineno = 0;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	fprintf(stderr, "tracegen: %s: %s\n", path, strerror(errno));
+	exit(1);
+    }
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	lineno++;
+	if ((hash = strchr(line, '#')) != NULL)
+	    *hash = '\0';
+	if (sscanf(line, " %[^= \t] = %s", key, val) != 2) {
+	    if (sscanf(line, " %s", key) == 1) {
+		fprintf(stderr, "tracegen: %s:%d: expected key = value\n",
+			path, lineno);
+		exit(1);
+	    }
+	    continue;
+	}
+
+	if (!strcmp(key, "seed")) prm.seed = strtoull(val, NULL, 0);
+	else if (!strcmp(key, "ops")) prm.ops = atol(val);
+	else if (!strcmp(key, "max_live")) prm.max_live = atol(val);
+	else if (!strcmp(key, "size_dist")) prm.size_dist = parse_dist(val);
+	else if (!strcmp(key, "size_min")) prm.size_min = atoi(val);
+	else if (!strcmp(key, "size_max")) prm.size_max = atoi(val);
+	else if (!strcmp(key, "size_alpha")) prm.size_alpha = atof(val);
+	else if (!strcmp(key, "size2_min")) prm.size2_min = atoi(val);
+	else if (!strcmp(key, "size2_max")) prm.size2_max = atoi(val);
+	else if (!strcmp(key, "size2_frac")) prm.size2_frac = atof(val);
+	else if (!strcmp(key, "life_dist")) prm.life_dist = parse_dist(val);
+	else if (!strcmp(key, "life_min")) prm.life_min = atoi(val);
+	else if (!strcmp(key, "life_max")) prm.life_max = atoi(val);
+	else if (!strcmp(key, "life_alpha")) prm.life_alpha = atof(val);
+	else if (!strcmp(key, "realloc_frac")) prm.realloc_frac = atof(val);
+	else if (!strcmp(key, "realloc_steps")) prm.realloc_steps = atoi(val);
+	else if (!strcmp(key, "realloc_growth")) prm.realloc_growth = atof(val);
+	else if (!strcmp(key, "phases")) prm.phases = atoi(val);
+	else if (!strcmp(key, "phase_scale")) prm.phase_scale = atof(val);
+	else if (!strcmp(key, "phase_free")) prm.phase_free = atof(val);
+	else if (!strcmp(key, "handoff_frac")) prm.handoff_frac = atof(val);
+	else if (!strcmp(key, "handoff_batch")) prm.handoff_batch = atoi(val);
+	else if (!strcmp(key, "handoff_depth")) prm.handoff_depth = atoi(val);
+	else {
+	    fprintf(stderr, "tracegen: %s:%d: unknown key %s\n",
+		    path, lineno, key);
+	    exit(1);
+	}
+    }
+    fclose(fp);
+
+    if (prm.size_min < 1 || prm.size_max < prm.size_min ||
+	prm.life_min < 1 || prm.life_max < prm.life_min ||
+	prm.phases < 1 || prm.handoff_batch < 1 || prm.handoff_depth < 1 ||
+	(prm.size_dist == DIST_BIMODAL &&
+	 (prm.size2_min < 1 || prm.size2_max < prm.size2_min)))
+	app_error("inconsistent parameters");
+}
+
+/*************
+ * Event heap
+ *************/
+
+static void heap_push(uint64_t time, int id, int kind)
+{
+    int i, parent;
+    event_t ev;
+
+    if (heap_len == heap_cap) {
+	heap_cap = heap_cap ? 2 * heap_cap : 1024;
+	heap = xrealloc(heap, heap_cap * sizeof(event_t));
+    }
+    ev.time = time;
+    ev.id = id;
+    ev.kind = kind;
+    for (i = heap_len++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (heap[parent].time <= time)
+	    break;
+	heap[i] = heap[parent];
+    }
+    heap[i] = ev;
+}
+
+static event_t heap_pop(void)
+{
+    event_t top = heap[0], last = heap[--heap_len];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < heap_len) {
+	if (child + 1 < heap_len && heap[child+1].time < heap[child].time)
+	    child++;
+	if (last.time <= heap[child].time)
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    if (heap_len)
+	heap[i] = last;
+    return top;
+}
+
+/**********
+ * Emitters
+ **********/
+
+static void emit(int type, int id, int size)
+{
+    static const char tag[3] = {'a', 'f', 'r'};
+
+    if (text_out) {
+	if (type == BTRACE_FREE)
+	    fprintf(body, "f %d\n", id);
+	else
+	    fprintf(body, "%c %d %d\n", tag[type], id, size);
+    }
+    else if (btrace_writer_put(&bw, type, id, size) < 0)
+	app_error("write failed");
+    now++;
+}
+
+static int new_block(int size)
+{
+    block_t *b;
+    int id = num_ids++;
+
+    if (num_ids > cap_ids) {
+	cap_ids = cap_ids ? 2 * cap_ids : 4096;
+	blocks = xrealloc(blocks, cap_ids * sizeof(block_t));
+	live = xrealloc(live, cap_ids * sizeof(int));
+    }
+    b = &blocks[id];
+    b->size = size;
+    b->live = 1;
+    b->steps = 0;
+    b->born = now;
+    b->death = 0;
+    b->livepos = num_live;
+    live[num_live++] = id;
+
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    emit(BTRACE_ALLOC, id, size);
+    return id;
+}
+
+static void free_block(int id)
+{
+    block_t *b = &blocks[id];
+    int last = live[--num_live];
+
+    live[b->livepos] = last;
+    blocks[last].livepos = b->livepos;
+    b->live = 0;
+    live_bytes -= b->size;
+    emit(BTRACE_FREE, id, 0);
+}
+
+static void grow_block(int id)
+{
+    block_t *b = &blocks[id];
+    long size = (long)(b->size * prm.realloc_growth);
+
+    if (size <= b->size)
+	size = b->size + 1;
+    if (size > (1 << 24))
+	size = 1 << 24;
+    live_bytes += size - b->size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    b->size = (int)size;
+    emit(BTRACE_REALLOC, id, b->size);
+}
+
+/*********************
+ * Workload generation
+ *********************/
+
+static int draw_size(void)
+{
+    long size;
+
+    switch (prm.size_dist) {
+    case DIST_FIXED:
+	size = prm.size_min;
+	break;
+    case DIST_BIMODAL:
+	if (rand_unit() < prm.size2_frac)
+	    size = rand_range(prm.size2_min, prm.size2_max);
+	else
+	    size = rand_range(prm.size_min, prm.size_max);
+	break;
+    case DIST_POWERLAW:
+	size = rand_powerlaw(prm.size_min, prm.size_max, prm.size_alpha);
+	break;
+    default:
+	size = rand_range(prm.size_min, prm.size_max);
+	break;
+    }
+    size = (long)(size * size_factor);
+    return (size < 1) ? 1 : (int)size;
+}
+
+static long draw_life(void)
+{
+    switch (prm.life_dist) {
+    case DIST_FIXED:
+	return prm.life_min;
+    case DIST_POWERLAW:
+	return rand_powerlaw(prm.life_min, prm.life_max, prm.life_alpha);
+    default:
+	return rand_range(prm.life_min, prm.life_max);
+    }
+}
+
+/*
+ * alloc_scheduled - Allocate a block whose free (and any reallocs
+ *     before it) are driven by the event heap
+ */
+static void alloc_scheduled(void)
+{
+    int id = new_block(draw_size());
+    block_t *b = &blocks[id];
+    long life = draw_life();
+
+    b->death = now + life;
+    if (prm.realloc_frac > 0 && rand_unit() < prm.realloc_frac &&
+	life > prm.realloc_steps) {
+	b->steps = prm.realloc_steps;
+	heap_push(b->born + life / (b->steps + 1), id, EV_GROW);
+    }
+    else
+	heap_push(b->death, id, EV_FREE);
+}
+
+/*
+ * run_event - Carry out a scheduled realloc or free, skipping events
+ *     for blocks that were already freed early
+ */
+static void run_event(event_t ev)
+{
+    block_t *b = &blocks[ev.id];
+
+    if (!b->live)
+	return;
+    if (ev.kind == EV_FREE) {
+	free_block(ev.id);
+	return;
+    }
+    grow_block(ev.id);
+    if (--b->steps > 0)
+	heap_push(now + (b->death - b->born) / (prm.realloc_steps + 1),
+		  ev.id, EV_GROW);
+    else
+	heap_push(b->death > now ? b->death : now, ev.id, EV_FREE);
+}
+
+/*
+ * handoff_burst - The producer allocates a batch into the FIFO, then
+ *     the consumer frees whatever is more than handoff_depth batches old
+ */
+static void handoff_burst(void)
+{
+    int i, id;
+
+    for (i = 0; i < prm.handoff_batch; i++) {
+	if (fifo_len == fifo_cap) {
+	    int j, *grown = xrealloc(NULL, (fifo_cap ? 2 * fifo_cap : 256) *
+				     sizeof(int));
+	    for (j = 0; j < fifo_len; j++)
+		grown[j] = fifo[(fifo_head + j) % fifo_cap];
+	    free(fifo);
+	    fifo = grown;
+	    fifo_head = 0;
+	    fifo_cap = fifo_cap ? 2 * fifo_cap : 256;
+	}
+	id = new_block(draw_size());
+	fifo[(fifo_head + fifo_len++) % fifo_cap] = id;
+    }
+    while (fifo_len > prm.handoff_batch * prm.handoff_depth) {
+	id = fifo[fifo_head];
+	fifo_head = (fifo_head + 1) % fifo_cap;
+	fifo_len--;
+	if (blocks[id].live)
+	    free_block(id);
+    }
+}
+
+/*
+ * change_phase - Scale future sizes and drop part of the live set
+ */
+static void change_phase(void)
+{
+    int n = (int)(num_live * prm.phase_free);
+
+    size_factor *= prm.phase_scale;
+    while (n-- > 0 && num_live > 0)
+	free_block(live[rand_range(0, num_live - 1)]);
+}
+
+/*
+ * fit_max_live - Free the blocks with the earliest scheduled events
+ *     until the live bytes fit under max_live. A pending realloc is not
+ *     run, since it would only add to the excess: its block is freed
+ *     there instead, cutting the growth chain short.
+ */
+static void fit_max_live(void)
+{
+    event_t ev;
+
+    while (live_bytes > prm.max_live && heap_len) {
+	ev = heap_pop();
+	if (blocks[ev.id].live)
+	    free_block(ev.id);
+    }
+}
+
+static void generate(void)
+{
+    int phase = 0, next;
+
+    while ((long)now < prm.ops) {
+	next = (int)((double)now * prm.phases / prm.ops);
+	if (next != phase) {
+	    phase = next;
+	    change_phase();
+	}
+
+	if (heap_len && heap[0].time <= now)
+	    run_event(heap_pop());
+	else if (prm.handoff_frac > 0 && rand_unit() < prm.handoff_frac)
+	    handoff_burst();
+	else
+	    alloc_scheduled();
+
+	fit_max_live();
+    }
+
+    /* Balance the trace: everything still live is freed */
+    while (heap_len)
+	run_event(heap_pop());
+    while (num_live)
+	free_block(live[num_live - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    long ops = -1;
+    long long seed = -1;
+    size_t len;
+    char buf[8192];
+    FILE *out;
+
+    while ((c = getopt(argc, argv, "n:s:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    ops = atol(optarg);
+	    break;
+	case 's':
+	    seed = atoll(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-n <ops>] [-s <seed>] <params> <out>\n",
+		    argv[0]);
+	    exit(1);
+	}
+    }
+    if (argc - optind != 2) {
+	fprintf(stderr, "usage: %s [-n <ops>] [-s <seed>] <params> <out>\n",
+		argv[0]);
+	exit(1);
+    }
+
+    read_params(argv[optind]);
+    if (ops > 0)
+	prm.ops = ops;
+    if (seed >= 0)
+	prm.seed = (uint64_t)seed;
+    rng = prm.seed;
+
+    len = strlen(argv[optind+1]);
+    text_out = (len > 4 && !strcmp(argv[optind+1] + len - 4, ".rep"));
+    if (text_out) {
+	if ((body = tmpfile()) == NULL)
+	    app_error("could not create temporary file");
+    }
+    else if (btrace_writer_open(&bw, argv[optind+1], 0, 1) < 0) {
+	fprintf(stderr, "tracegen: %s: %s\n", argv[optind+1], strerror(errno));
+	exit(1);
+    }
+
+    generate();
+
+    if (text_out) {
+	/* The header needs the final counts, so it goes in front last */
+	if ((out = fopen(argv[optind+1], "w")) == NULL) {
+	    fprintf(stderr, "tracegen: %s: %s\n", argv[optind+1],
+		    strerror(errno));
+	    exit(1);
+	}
+	fprintf(out, "%ld\n%d\n%llu\n1\n", peak_bytes, num_ids,
+		(unsigned long long)now);
+	rewind(body);
+	while ((len = fread(buf, 1, sizeof(buf), body)) > 0)
+	    fwrite(buf, 1, len, out);
+	if (fclose(out) != 0)
+	    app_error("write failed");
+    }
+    else {
+	bw.hdr.sugg_heapsize = (int32_t)peak_bytes;
+	if (btrace_writer_close(&bw) < 0)
+	    app_error("write failed");
+    }
+
+    printf("%s: %llu ops, %d ids, peak live %ld bytes\n", argv[optind+1],
+	   (unsigned long long)now, num_ids, peak_bytes);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// affinity.h - pin threads to cores and pick cores that don't share one.
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <pthread.h>
+
+namespace bench
+{
+    // Parses a Linux cpulist such as "0-3,8,10-11"; empty on a malformed list
+    inline std::vector<int> parse_cpulist(const std::string &list)
+    {
+        std::vector<int> cpus;
+        size_t pos = 0;
+        while (pos < list.size() && list[pos] != '\n')
+        {
+            size_t end;
+            int lo, hi;
+            try
+            {
+                lo = hi = std::stoi(list.substr(pos), &end);
+                pos += end;
+                if (pos < list.size() && list[pos] == '-')
+                {
+                    hi = std::stoi(list.substr(pos + 1), &end);
+                    pos += end + 1;
+                }
+            }
+            catch (const std::exception &)
+            {
+                return {};
+            }
+            for (int c = lo; c <= hi; ++c)
+                cpus.push_back(c);
+            if (pos < list.size() && list[pos] == ',')
+                ++pos;
+        }
+        return cpus;
+    }
+
+    // Pins thread t to core; prints the outcome to log if it is given
+    inline bool pin_thread(pthread_t t, int core, std::ostream *log = nullptr)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(core, &cpuset);
+        if (pthread_setaffinity_np(t, sizeof(cpu_set_t), &cpuset) != 0)
+        {
+            std::cerr << "Warning: Could not set CPU affinity to core " << core << std::endl;
+            perror("pthread_setaffinity_np");
+            return false;
+        }
+        if (log)
+            *log << "Successfully pinned process to core " << core << std::endl;
+        return true;
+    }
+
+    inline bool pin_current_thread(int core, std::ostream *log = nullptr)
+    {
+        return pin_thread(pthread_self(), core, log);
+    }
+
+    // The cores this process may run on, in order. With one_per_core, only the
+    // first hardware thread of each physical core is kept, so that threads
+    // placed on the result don't share a core's private caches and ports.
+    inline std::vector<int> usable_cores(bool one_per_core = true)
+    {
+        cpu_set_t allowed;
+        std::vector<int> cores;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return cores;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+            bool sibling_taken = false;
+            if (one_per_core)
+            {
+                std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                                 "/topology/thread_siblings_list");
+                std::string list;
+                if (std::getline(in, list))
+                    for (int sib : parse_cpulist(list))
+                        if (sib < cpu && CPU_ISSET(sib, &allowed))
+                            sibling_taken = true;
+            }
+            if (!sibling_taken)
+                cores.push_back(cpu);
+        }
+        return cores;
+    }
+} // namespace bench
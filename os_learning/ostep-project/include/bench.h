@@ -0,0 +1,431 @@
+// bench.h - a small harness for the ostep microbenchmarks: warm-up and
+// repeated runs, the median with a bootstrap confidence interval after
+// outlier rejection, compiler barriers, a check that the cpu clock holds
+// still, pinning, hardware counters where perf_event allows, and JSON output.
+//
+// A benchmark makes a Harness, then hands it one repetition at a time:
+//
+//     bench::Harness h("cache", bench::parse_args(argc, argv));
+//     h.measure("L1", "ns", [&] { return chase.ns_per_load(n, 1); });
+//     h.time("lock", [&] { lock(); unlock(); }, 1);   // ns per call
+//     h.finish();
+//
+// parse_args takes --reps=N, --warmup=N, --cpu=N, --json=FILE and
+// --no-counters out of argv, so the program's own getopt never sees them.
+// With counters, h.per(n).measure(...) reports each event per n items.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "affinity.h"
+#include "perf_counters.h"
+
+namespace bench
+{
+    // Makes the compiler believe value is read (and, if it is an lvalue,
+    // written), so the code computing it can't be dropped or hoisted
+    template <typename T>
+    inline void DoNotOptimize(T const &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    template <typename T>
+    inline void DoNotOptimize(T &value)
+    {
+#if defined(__clang__)
+        asm volatile("" : "+r,m"(value) : : "memory");
+#else
+        asm volatile("" : "+m,r"(value) : : "memory");
+#endif
+    }
+
+    // Makes the compiler believe all memory may have been read and written
+    inline void ClobberMemory()
+    {
+        asm volatile("" : : : "memory");
+    }
+
+    struct Stats
+    {
+        std::string name;
+        std::string unit;
+        size_t samples{0};  // kept after outlier rejection
+        size_t rejected{0};
+        double median{0};
+        double ci_lo{0};    // 95% bootstrap interval of the median
+        double ci_hi{0};
+        double mean{0};
+        double min{0};
+        double max{0};
+        // Hardware events per item, averaged over the timed runs; empty
+        // without counters
+        std::vector<std::pair<std::string, double>> counters;
+    };
+
+    inline double median_of(std::vector<double> v)
+    {
+        if (v.empty())
+            return 0;
+        size_t mid = v.size() / 2;
+        std::nth_element(v.begin(), v.begin() + mid, v.end());
+        double m = v[mid];
+        if (v.size() % 2 == 0)
+            m = (m + *std::max_element(v.begin(), v.begin() + mid)) / 2;
+        return m;
+    }
+
+    // Drops samples more than 3 scaled MADs from the median (a context switch
+    // or an interrupt only ever makes a run slower, and the mean would follow
+    // it), then bootstraps the median of the rest
+    inline Stats summarize(const std::vector<double> &raw, int resamples = 2000, uint64_t seed = 1)
+    {
+        Stats s;
+        if (raw.empty())
+            return s;
+        double med = median_of(raw);
+        std::vector<double> dev;
+        for (double x : raw)
+            dev.push_back(std::fabs(x - med));
+        double mad = 1.4826 * median_of(dev);
+
+        std::vector<double> kept;
+        for (double x : raw)
+            if (mad == 0 || std::fabs(x - med) <= 3 * mad)
+                kept.push_back(x);
+        s.samples = kept.size();
+        s.rejected = raw.size() - kept.size();
+        s.median = median_of(kept);
+        s.min = *std::min_element(kept.begin(), kept.end());
+        s.max = *std::max_element(kept.begin(), kept.end());
+        for (double x : kept)
+            s.mean += x / kept.size();
+
+        std::mt19937_64 rng(seed);
+        std::uniform_int_distribution<size_t> pick(0, kept.size() - 1);
+        std::vector<double> medians(resamples), sample(kept.size());
+        for (int r = 0; r < resamples; ++r)
+        {
+            for (double &x : sample)
+                x = kept[pick(rng)];
+            medians[r] = median_of(sample);
+        }
+        std::sort(medians.begin(), medians.end());
+        s.ci_lo = medians[size_t(0.025 * (resamples - 1))];
+        s.ci_hi = medians[size_t(0.975 * (resamples - 1))];
+        return s;
+    }
+
+    // What cpufreq says about the clock of one cpu. A governor other than
+    // performance ramps the clock during a run, and turbo makes it depend on
+    // temperature and on what the other cores do; both show up as noise.
+    struct SystemInfo
+    {
+        int cpu{0};
+        std::string governor;  // empty when there is no cpufreq (e.g. a VM)
+        double cur_mhz{0};
+        double max_mhz{0};
+        int turbo{-1};         // 1 on, 0 off, -1 unknown
+        std::vector<std::string> warnings;
+    };
+
+    inline std::string read_sysfs(const std::string &path)
+    {
+        std::ifstream in(path);
+        std::string s;
+        std::getline(in, s);
+        return s;
+    }
+
+    inline SystemInfo check_system(int cpu)
+    {
+        SystemInfo info;
+        info.cpu = cpu;
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/";
+        info.governor = read_sysfs(dir + "scaling_governor");
+        std::string cur = read_sysfs(dir + "scaling_cur_freq");
+        std::string max = read_sysfs(dir + "cpuinfo_max_freq");
+        if (!cur.empty())
+            info.cur_mhz = std::atof(cur.c_str()) / 1000;
+        if (!max.empty())
+            info.max_mhz = std::atof(max.c_str()) / 1000;
+
+        std::string no_turbo = read_sysfs("/sys/devices/system/cpu/intel_pstate/no_turbo");
+        std::string boost = read_sysfs("/sys/devices/system/cpu/cpufreq/boost");
+        if (!no_turbo.empty())
+            info.turbo = no_turbo == "0";
+        else if (!boost.empty())
+            info.turbo = boost == "1";
+
+        if (info.governor.empty())
+            info.warnings.push_back("no cpufreq for cpu " + std::to_string(cpu) +
+                                    ": clock speed unknown");
+        else if (info.governor != "performance")
+            info.warnings.push_back("cpu " + std::to_string(cpu) + " governor is " + info.governor +
+                                    ", not performance: the clock may ramp during runs");
+        if (info.turbo == 1)
+            info.warnings.push_back("turbo is on: results depend on temperature and load");
+        return info;
+    }
+
+    struct Options
+    {
+        int warmup{2};     // untimed runs before the timed ones
+        int reps{11};      // timed runs
+        int cpu{-1};       // pin to this cpu when >= 0
+        std::string json;  // write the results here when not empty
+        bool counters{true};
+    };
+
+    // Takes the harness's --options out of argv and returns them
+    inline Options parse_args(int &argc, char **argv, Options opts = {})
+    {
+        int kept = 1;
+        for (int i = 1; i < argc; ++i)
+        {
+            const char *a = argv[i];
+            if (std::strncmp(a, "--reps=", 7) == 0)
+                opts.reps = std::max(1, std::atoi(a + 7));
+            else if (std::strncmp(a, "--warmup=", 9) == 0)
+                opts.warmup = std::max(0, std::atoi(a + 9));
+            else if (std::strncmp(a, "--cpu=", 6) == 0)
+                opts.cpu = std::atoi(a + 6);
+            else if (std::strncmp(a, "--json=", 7) == 0)
+                opts.json = a + 7;
+            else if (std::strcmp(a, "--no-counters") == 0)
+                opts.counters = false;
+            else
+                argv[kept++] = argv[i];
+        }
+        argc = kept;
+        argv[argc] = nullptr;
+        return opts;
+    }
+
+    // Evicts the caches by writing a buffer bigger than them. The buffer is
+    // allocated (and faulted in) once, not on every flush.
+    class CacheFlusher
+    {
+    public:
+        explicit CacheFlusher(size_t bytes)
+            : m_buf(bytes, 0)
+        {
+        }
+
+        void operator()()
+        {
+            ++m_round;
+            for (size_t i = 0; i < m_buf.size(); i += 64)
+                m_buf[i] = static_cast<char>(m_round + i);
+            ClobberMemory();
+        }
+
+    private:
+        std::vector<char> m_buf;
+        unsigned m_round{0};
+    };
+
+    class Harness
+    {
+    public:
+        Harness(std::string suite, Options opts = {})
+            : m_suite{std::move(suite)}, m_opts{std::move(opts)}
+        {
+            if (m_opts.cpu >= 0)
+                pin_current_thread(m_opts.cpu);
+            m_system = check_system(std::max(m_opts.cpu, 0));
+            for (const std::string &w : m_system.warnings)
+                std::cerr << "Warning: " << w << std::endl;
+            if (m_opts.counters)
+            {
+                m_counters = std::make_unique<PerfCounters>();
+                if (!m_counters->available())
+                {
+                    std::cerr << "Warning: no hardware counters (" << m_counters->error()
+                              << "); timing only" << std::endl;
+                    m_counters.reset();
+                }
+            }
+        }
+
+        const Options &options() const { return m_opts; }
+        const SystemInfo &system() const { return m_system; }
+        const std::vector<Stats> &results() const { return m_results; }
+        bool has_counters() const { return m_counters != nullptr; }
+
+        // The next measurement does items units of work per run (loads,
+        // lock/unlock pairs, ...); its counters are reported per item
+        Harness &per(double items)
+        {
+            m_items = items;
+            return *this;
+        }
+
+        // Runs fn warmup times, then reps times, keeping what each run
+        // returns (e.g. the ns per load a chase measured itself). setup runs
+        // untimed before every run, e.g. to flush the caches.
+        template <typename F, typename S>
+        const Stats &measure(const std::string &name, const std::string &unit, F &&fn, S &&setup)
+        {
+            for (int i = 0; i < m_opts.warmup; ++i)
+            {
+                setup();
+                fn();
+            }
+            std::vector<double> samples;
+            std::vector<double> counts(m_counters ? m_counters->size() : 0, 0.0);
+            for (int i = 0; i < m_opts.reps; ++i)
+            {
+                setup();
+                if (m_counters)
+                    m_counters->start();
+                samples.push_back(fn());
+                if (m_counters)
+                {
+                    m_counters->stop();
+                    for (size_t e = 0; e < counts.size(); ++e)
+                        counts[e] += m_counters->value(e);
+                }
+            }
+            Stats s = summarize(samples);
+            s.name = name;
+            s.unit = unit;
+            for (size_t e = 0; e < counts.size(); ++e)
+                if (m_counters->opened(e))
+                    s.counters.emplace_back(m_counters->name(e), counts[e] / m_opts.reps / m_items);
+            m_items = 1;
+            m_results.push_back(s);
+            return m_results.back();
+        }
+
+        template <typename F>
+        const Stats &measure(const std::string &name, const std::string &unit, F &&fn)
+        {
+            return measure(name, unit, std::forward<F>(fn), [] {});
+        }
+
+        // Times fn, which does items units of work per call; ns per item
+        template <typename F>
+        const Stats &time(const std::string &name, F &&fn, double items = 1)
+        {
+            per(items);
+            return measure(name, "ns", [&] {
+                auto t0 = std::chrono::steady_clock::now();
+                fn();
+                ClobberMemory();
+                auto t1 = std::chrono::steady_clock::now();
+                return std::chrono::duration<double, std::nano>(t1 - t0).count() / items;
+            });
+        }
+
+        // One line per result, and its counters under it
+        void print(FILE *out) const
+        {
+            for (const Stats &s : m_results)
+            {
+                std::fprintf(out, "%-24s %10.3f %s  [%.3f, %.3f]  n=%zu%s\n", s.name.c_str(),
+                             s.median, s.unit.c_str(), s.ci_lo, s.ci_hi, s.samples,
+                             s.rejected ? (" (" + std::to_string(s.rejected) + " outliers)").c_str() : "");
+                print_counters(out, s, "    per item:");
+            }
+        }
+
+        // "prefix name value name value ..." when s has counters
+        static void print_counters(FILE *out, const Stats &s, const char *prefix)
+        {
+            if (s.counters.empty())
+                return;
+            std::fprintf(out, "%s", prefix);
+            for (const auto &c : s.counters)
+                std::fprintf(out, " %s %.3f", c.first.c_str(), c.second);
+            std::fprintf(out, "\n");
+        }
+
+        void write_json(FILE *out) const
+        {
+            std::fprintf(out, "{\n  \"suite\": \"%s\",\n", escape(m_suite).c_str());
+            std::fprintf(out, "  \"system\": {\"cpu\": %d, \"governor\": \"%s\", \"cur_mhz\": %.0f, "
+                              "\"max_mhz\": %.0f, \"turbo\": %d, \"warnings\": [",
+                         m_system.cpu, escape(m_system.governor).c_str(), m_system.cur_mhz,
+                         m_system.max_mhz, m_system.turbo);
+            for (size_t i = 0; i < m_system.warnings.size(); ++i)
+                std::fprintf(out, "%s\"%s\"", i ? ", " : "", escape(m_system.warnings[i]).c_str());
+            std::fprintf(out, "]},\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"results\": [\n",
+                         m_opts.warmup, m_opts.reps);
+            for (size_t i = 0; i < m_results.size(); ++i)
+            {
+                const Stats &s = m_results[i];
+                std::fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"median\": %.6g, "
+                                  "\"ci95\": [%.6g, %.6g], \"mean\": %.6g, \"min\": %.6g, \"max\": %.6g, "
+                                  "\"samples\": %zu, \"rejected\": %zu",
+                             escape(s.name).c_str(), escape(s.unit).c_str(), s.median, s.ci_lo,
+                             s.ci_hi, s.mean, s.min, s.max, s.samples, s.rejected);
+                if (!s.counters.empty())
+                {
+                    std::fprintf(out, ", \"counters_per_item\": {");
+                    for (size_t c = 0; c < s.counters.size(); ++c)
+                    {
+                        // null for an event that never got a counter
+                        std::fprintf(out, "%s\"%s\": ", c ? ", " : "", s.counters[c].first.c_str());
+                        if (std::isnan(s.counters[c].second))
+                            std::fprintf(out, "null");
+                        else
+                            std::fprintf(out, "%.6g", s.counters[c].second);
+                    }
+                    std::fprintf(out, "}");
+                }
+                std::fprintf(out, "}%s\n", i + 1 < m_results.size() ? "," : "");
+            }
+            std::fprintf(out, "  ]\n}\n");
+        }
+
+        // Writes the JSON file if --json asked for one
+        void finish() const
+        {
+            if (m_opts.json.empty())
+                return;
+            FILE *out = std::fopen(m_opts.json.c_str(), "w");
+            if (!out)
+            {
+                std::perror(m_opts.json.c_str());
+                return;
+            }
+            write_json(out);
+            std::fclose(out);
+        }
+
+    private:
+        static std::string escape(const std::string &s)
+        {
+            std::string e;
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    e += '\\';
+                if (static_cast<unsigned char>(c) >= 0x20)
+                    e += c;
+            }
+            return e;
+        }
+
+        std::string m_suite;
+        Options m_opts;
+        SystemInfo m_system;
+        std::unique_ptr<PerfCounters> m_counters;
+        double m_items{1};
+        std::vector<Stats> m_results;
+    };
+} // namespace bench
@@ -0,0 +1,178 @@
+// cache_info.h - discover the data cache hierarchy of the machine we run on.
+//
+// Reads /sys/devices/system/cpu/cpuN/cache/index*/ on Linux and falls back
+// to cpuid (leaf 4 on Intel, 0x8000001D on AMD) when sysfs is missing, e.g.
+// in some containers.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace bench
+{
+    struct CacheLevel
+    {
+        int level{0};          // 1, 2, 3, ...
+        std::string type;      // "Data", "Instruction" or "Unified"
+        size_t size{0};        // bytes
+        size_t line{0};        // bytes per line
+        int ways{0};           // associativity (0 if unknown)
+        std::string shared_cpus; // cpulist sharing this cache, if known
+
+        std::string name() const
+        {
+            std::string n = "L" + std::to_string(level);
+            if (type == "Data")
+                n += "d";
+            else if (type == "Instruction")
+                n += "i";
+            return n;
+        }
+    };
+
+    namespace detail
+    {
+        inline bool read_line(const std::string &path, std::string &out)
+        {
+            std::ifstream in(path);
+            return static_cast<bool>(std::getline(in, out));
+        }
+
+        // Parses "48K", "2048K", "32M" or a plain byte count
+        inline size_t parse_size(const std::string &s)
+        {
+            size_t pos = 0;
+            size_t n = std::stoul(s, &pos);
+            if (pos < s.size() && (s[pos] == 'K' || s[pos] == 'k'))
+                n <<= 10;
+            else if (pos < s.size() && (s[pos] == 'M' || s[pos] == 'm'))
+                n <<= 20;
+            return n;
+        }
+
+        inline std::vector<CacheLevel> from_sysfs(int cpu)
+        {
+            std::vector<CacheLevel> caches;
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/index";
+            for (int i = 0;; ++i)
+            {
+                std::string dir = base + std::to_string(i) + "/", s;
+                if (!read_line(dir + "level", s))
+                    break;
+                CacheLevel c;
+                try
+                {
+                    c.level = std::stoi(s);
+                    if (read_line(dir + "type", s))
+                        c.type = s;
+                    if (read_line(dir + "size", s))
+                        c.size = parse_size(s);
+                    if (read_line(dir + "coherency_line_size", s))
+                        c.line = std::stoul(s);
+                    if (read_line(dir + "ways_of_associativity", s))
+                        c.ways = std::stoi(s);
+                }
+                catch (const std::exception &)
+                {
+                    continue;
+                }
+                read_line(dir + "shared_cpu_list", c.shared_cpus);
+                if (c.size > 0)
+                    caches.push_back(c);
+            }
+            return caches;
+        }
+
+        inline std::vector<CacheLevel> from_cpuid()
+        {
+            std::vector<CacheLevel> caches;
+#if defined(__x86_64__) || defined(__i386__)
+            unsigned a, b, c, d;
+            unsigned leaf = 4;
+            if (__get_cpuid(0, &a, &b, &c, &d) && b == 0x68747541) // "Auth"enticAMD
+                leaf = 0x8000001D;
+            if (leaf == 4 && __get_cpuid_max(0, nullptr) < 4)
+                return caches;
+            if (leaf != 4 && __get_cpuid_max(0x80000000, nullptr) < leaf)
+                return caches;
+            for (unsigned i = 0; i < 16; ++i)
+            {
+                __cpuid_count(leaf, i, a, b, c, d);
+                unsigned type = a & 0x1f;
+                if (type == 0)
+                    break;
+                CacheLevel lvl;
+                lvl.level = (a >> 5) & 0x7;
+                lvl.type = type == 1 ? "Data" : type == 2 ? "Instruction" : "Unified";
+                lvl.line = (b & 0xfff) + 1;
+                size_t partitions = ((b >> 12) & 0x3ff) + 1;
+                lvl.ways = static_cast<int>(((b >> 22) & 0x3ff) + 1);
+                lvl.size = lvl.line * partitions * lvl.ways * (static_cast<size_t>(c) + 1);
+                caches.push_back(lvl);
+            }
+#endif
+            return caches;
+        }
+    } // namespace detail
+
+    // All caches seen by cpu, ordered by level (instruction caches included)
+    inline std::vector<CacheLevel> discover_caches(int cpu = 0)
+    {
+        std::vector<CacheLevel> caches = detail::from_sysfs(cpu);
+        if (caches.empty())
+            caches = detail::from_cpuid();
+        std::stable_sort(caches.begin(), caches.end(),
+                         [](const CacheLevel &x, const CacheLevel &y)
+                         { return x.level < y.level; });
+        return caches;
+    }
+
+    // Only the caches that hold data, innermost first
+    inline std::vector<CacheLevel> data_caches(const std::vector<CacheLevel> &all)
+    {
+        std::vector<CacheLevel> out;
+        for (const auto &c : all)
+            if (c.type != "Instruction")
+                out.push_back(c);
+        return out;
+    }
+
+    // Size of the outermost data cache, or fallback if none was found
+    inline size_t llc_size(const std::vector<CacheLevel> &all, size_t fallback = 8u << 20)
+    {
+        auto d = data_caches(all);
+        return d.empty() ? fallback : d.back().size;
+    }
+
+    // Line size of the innermost data cache, or fallback if none was found
+    inline size_t line_size(const std::vector<CacheLevel> &all, size_t fallback = 64)
+    {
+        auto d = data_caches(all);
+        return (d.empty() || d.front().line == 0) ? fallback : d.front().line;
+    }
+
+    // Name of the innermost data cache that holds a working set of bytes
+    inline std::string level_for(const std::vector<CacheLevel> &all, size_t bytes)
+    {
+        for (const auto &c : data_caches(all))
+            if (bytes <= c.size)
+                return c.name();
+        return "DRAM";
+    }
+
+    inline void print_caches(const std::vector<CacheLevel> &all, FILE *out = stdout)
+    {
+        for (const auto &c : all)
+            std::fprintf(out, "# %-4s %8zu KiB  %3zu B lines  %2d-way  cpus %s\n",
+                         c.name().c_str(), c.size >> 10, c.line, c.ways,
+                         c.shared_cpus.empty() ? "?" : c.shared_cpus.c_str());
+    }
+} // namespace bench
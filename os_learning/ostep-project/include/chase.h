@@ -0,0 +1,282 @@
+// chase.h - pointer-chase chains for measuring load-to-use latency.
+//
+// A chain is a set of nodes, one per cache line, where each node holds the
+// address of the next one to load. Every load depends on the one before, so
+// the time per step is the latency of wherever the node lives. For that to
+// hold, the order must defeat the prefetcher and must visit every node before
+// coming back to the first. A plain std::shuffle of indices fails the second
+// test: it makes a random permutation, whose cycles are mostly short, so the
+// chase gets trapped in a few nodes that fit in L1. Sattolo's variant of the
+// Fisher-Yates shuffle only makes permutations that are a single cycle.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace bench
+{
+    struct ChaseNode
+    {
+        ChaseNode *next;
+    };
+
+    // Where chases leave their last node, so the compiler must run them
+    inline ChaseNode *volatile chase_sink;
+
+    // Shuffles v into a random single cycle: v[i] -> v[i+1] -> ... -> v[0]
+    template <typename T, typename Rng>
+    void sattolo(std::vector<T> &v, Rng &rng)
+    {
+        for (size_t i = v.size(); i > 1; --i)
+        {
+            std::uniform_int_distribution<size_t> pick(0, i - 2);
+            std::swap(v[i - 1], v[pick(rng)]);
+        }
+    }
+
+    // Follows K chains at once, each from its own start, for steps steps each;
+    // best ns per load (over all chains) of reps runs. K is a template
+    // parameter so the K pointers live in registers and the loop body is
+    // just K independent loads.
+    template <int K>
+    double chase_parallel(ChaseNode *const *starts, long long steps, int reps)
+    {
+        ChaseNode *p[K];
+        for (int j = 0; j < K; ++j)
+            p[j] = starts[j];
+        double best = 1e30;
+        for (int r = 0; r < reps; ++r)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            for (long long i = 0; i < steps; ++i)
+                for (int j = 0; j < K; ++j)
+                    p[j] = p[j]->next;
+            auto t1 = std::chrono::steady_clock::now();
+            std::chrono::duration<double, std::nano> d = t1 - t0;
+            best = std::min(best, d.count() / (steps * K));
+        }
+        for (int j = 0; j < K; ++j)
+            chase_sink = p[j];
+        return best;
+    }
+
+    constexpr int max_parallel_chains = 32;
+
+    template <int... Ks>
+    constexpr auto make_parallel_table(std::integer_sequence<int, Ks...>)
+    {
+        using Fn = double (*)(ChaseNode *const *, long long, int);
+        return std::array<Fn, sizeof...(Ks)>{chase_parallel<Ks + 1>...};
+    }
+
+    enum class ChaseOrder
+    {
+        Random,    // all lines in one random cycle: misses in cache and TLB
+        PageLocal, // pages in a random cycle, and the lines of each page in a
+                   // random order before moving on, so a TLB miss is paid once
+                   // per page rather than on almost every load
+    };
+
+    // What backs a chase buffer
+    enum class Backing
+    {
+        Small,       // 4 KiB pages only (MADV_NOHUGEPAGE)
+        Transparent, // 2 MiB-aligned and MADV_HUGEPAGE: huge pages if THP allows
+        HugeTLB,     // MAP_HUGETLB 2 MiB pages from the reserved pool
+    };
+
+    constexpr size_t huge_page_size = 2 << 20;
+
+    // Whether bytes of MAP_HUGETLB pages can be had right now
+    inline bool hugetlb_available(size_t bytes)
+    {
+        bytes = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+        munmap(p, bytes);
+        return true;
+    }
+
+    // A buffer of memory that chains of any size up to its capacity are built in
+    class Chase
+    {
+    public:
+        explicit Chase(size_t capacity, Backing backing = Backing::Transparent)
+            : m_capacity{capacity}
+        {
+            // Over-map by a huge page so the buffer can start on a 2 MiB
+            // boundary; THP can only back aligned 2 MiB ranges
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+            m_mapped = capacity + huge_page_size;
+            if (backing == Backing::HugeTLB)
+            {
+                flags |= MAP_HUGETLB;
+                m_mapped = (capacity + huge_page_size - 1) / huge_page_size * huge_page_size;
+            }
+            void *p = mmap(nullptr, m_mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (p == MAP_FAILED)
+            {
+                std::perror("mmap");
+                std::exit(1);
+            }
+            m_map = static_cast<char *>(p);
+            uintptr_t aligned = (reinterpret_cast<uintptr_t>(p) + huge_page_size - 1) &
+                                ~uintptr_t(huge_page_size - 1);
+            m_base = reinterpret_cast<char *>(aligned);
+            if (backing == Backing::Small)
+                madvise(m_map, m_mapped, MADV_NOHUGEPAGE);
+            else if (backing == Backing::Transparent)
+                madvise(m_map, m_mapped, MADV_HUGEPAGE);
+        }
+        ~Chase() { munmap(m_map, m_mapped); }
+        Chase(const Chase &) = delete;
+        Chase &operator=(const Chase &) = delete;
+
+        // Links the first bytes of the buffer into one cycle with a node every
+        // line bytes. page is the unit PageLocal keeps together.
+        void link(size_t bytes, size_t line, ChaseOrder order, uint64_t seed = 12345,
+                  size_t page = 4096)
+        {
+            std::mt19937_64 rng(seed);
+            bytes = std::min(bytes, m_capacity);
+            line = std::max(line, sizeof(ChaseNode));
+            size_t n = bytes / line;
+            if (n == 0)
+                return;
+
+            std::vector<size_t> visit; // node offsets in the order chased
+            visit.reserve(n);
+            size_t per_page = std::max<size_t>(page / line, 1);
+            if (order == ChaseOrder::Random || n <= per_page)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    visit.push_back(i * line);
+                sattolo(visit, rng);
+            }
+            else
+            {
+                std::vector<size_t> pages((n + per_page - 1) / per_page), lines;
+                std::iota(pages.begin(), pages.end(), 0);
+                sattolo(pages, rng);
+                for (size_t pg : pages)
+                {
+                    lines.clear();
+                    for (size_t i = pg * per_page; i < std::min(n, (pg + 1) * per_page); ++i)
+                        lines.push_back(i * line);
+                    std::shuffle(lines.begin(), lines.end(), rng);
+                    visit.insert(visit.end(), lines.begin(), lines.end());
+                }
+            }
+            for (size_t i = 0; i < n; ++i)
+                node(visit[i])->next = node(visit[(i + 1) % n]);
+            m_head = node(visit[0]);
+            m_nodes = n;
+        }
+
+        // Links one node in each of the first count strides of the buffer, in
+        // a random single cycle. The node sits at a random line of its stride:
+        // at a fixed line all nodes would share a few cache sets (on a huge
+        // page, whose frames are contiguous, as much as on small ones), and
+        // the chase would miss in the cache long before it missed in the TLB.
+        void link_strided(size_t count, size_t stride, size_t line, uint64_t seed = 12345)
+        {
+            std::mt19937_64 rng(seed);
+            line = std::max(line, sizeof(ChaseNode));
+            stride = std::max(stride, line);
+            count = std::min(count, m_capacity / stride);
+            if (count == 0)
+                return;
+
+            std::uniform_int_distribution<size_t> pick_line(0, stride / line - 1);
+            std::vector<size_t> visit(count);
+            for (size_t i = 0; i < count; ++i)
+                visit[i] = i * stride + pick_line(rng) * line;
+            sattolo(visit, rng);
+            for (size_t i = 0; i < count; ++i)
+                node(visit[i])->next = node(visit[(i + 1) % count]);
+            m_head = node(visit[0]);
+            m_nodes = count;
+        }
+
+        // Follows the chain for loads steps and returns ns per load, the best of
+        // reps timed runs after one warm-up lap (skip it with lap = false when
+        // the caller warms up itself, e.g. under the bench.h harness). The loop
+        // body is nothing but dependent loads: no index arithmetic, no bounds
+        // wrap, no divide.
+        double ns_per_load(long long loads, int reps = 3, bool lap = true) const
+        {
+            ChaseNode *p = m_head;
+            double best = 1e30;
+            loads = std::max(8LL, loads & ~7LL);
+            for (size_t i = 0; lap && i < m_nodes; ++i)
+                p = p->next;
+            for (int r = 0; r < reps; ++r)
+            {
+                auto t0 = std::chrono::steady_clock::now();
+                for (long long i = 0; i < loads; i += 8)
+                {
+                    p = p->next; p = p->next; p = p->next; p = p->next;
+                    p = p->next; p = p->next; p = p->next; p = p->next;
+                }
+                auto t1 = std::chrono::steady_clock::now();
+                std::chrono::duration<double, std::nano> d = t1 - t0;
+                best = std::min(best, d.count() / loads);
+            }
+            chase_sink = p;
+            return best;
+        }
+
+        // Memory-level parallelism: follows k chains through the cycle at once,
+        // starting n/k nodes apart so they never touch the same node, and
+        // returns ns per load over all of them. With one chain this is the
+        // load-to-use latency; as k grows the misses overlap, and the time per
+        // load falls until the core or the memory system can't keep more in
+        // flight. loads is the total over all chains.
+        double ns_per_load_parallel(long long loads, int k, int reps = 3) const
+        {
+            static constexpr auto table =
+                make_parallel_table(std::make_integer_sequence<int, max_parallel_chains>{});
+            k = std::clamp<int>(k, 1, std::min<size_t>(max_parallel_chains, std::max<size_t>(m_nodes, 1)));
+
+            std::vector<ChaseNode *> starts;
+            ChaseNode *p = m_head;
+            for (size_t i = 0; i < m_nodes && (int)starts.size() < k; ++i, p = p->next)
+                if (i == starts.size() * m_nodes / k)
+                    starts.push_back(p);
+            long long steps = std::max(1LL, loads / k);
+            table[k - 1](starts.data(), std::max<long long>(1, m_nodes / k), 1); // warm-up lap
+            return table[k - 1](starts.data(), steps, reps);
+        }
+
+        char *base() const { return m_base; }
+        ChaseNode *head() const { return m_head; }
+        size_t nodes() const { return m_nodes; }
+        size_t capacity() const { return m_capacity; }
+
+    private:
+        ChaseNode *node(size_t offset) const
+        {
+            return reinterpret_cast<ChaseNode *>(m_base + offset);
+        }
+
+        char *m_map{nullptr};  // the mapping; m_base is its aligned start
+        size_t m_mapped{0};
+        char *m_base{nullptr};
+        size_t m_capacity{0};
+        ChaseNode *m_head{nullptr};
+        size_t m_nodes{0};
+    };
+} // namespace bench
@@ -0,0 +1,65 @@
+// numa.h - NUMA nodes and memory binding through the raw syscalls, so that
+// nothing needs libnuma.
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "affinity.h"
+
+namespace bench
+{
+    // The online nodes; {0} when the kernel has no NUMA support
+    inline std::vector<int> numa_nodes()
+    {
+        std::ifstream in("/sys/devices/system/node/online");
+        std::string list;
+        std::vector<int> nodes;
+        if (std::getline(in, list))
+            nodes = parse_cpulist(list);
+        if (nodes.empty())
+            nodes.push_back(0);
+        return nodes;
+    }
+
+    // The cpus of node; every cpu we may use when sysfs doesn't say
+    inline std::vector<int> node_cpus(int node)
+    {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (std::getline(in, list))
+            return parse_cpulist(list);
+        return usable_cores(false);
+    }
+
+    // Binds [addr, addr+len) to node with MPOL_BIND, moving pages that were
+    // already touched. addr must be page aligned.
+    inline bool bind_memory(void *addr, size_t len, int node)
+    {
+        const unsigned long bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(node / bits + 1, 0);
+        mask[node / bits] |= 1UL << (node % bits);
+        if (syscall(SYS_mbind, addr, len, MPOL_BIND, mask.data(), mask.size() * bits + 1,
+                    MPOL_MF_STRICT | MPOL_MF_MOVE) != 0)
+        {
+            std::perror("mbind");
+            return false;
+        }
+        return true;
+    }
+
+    // The node the page holding addr is on; -1 if not yet faulted in or unknown
+    inline int node_of(const void *addr)
+    {
+        int node = -1;
+        if (syscall(SYS_get_mempolicy, &node, nullptr, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) != 0)
+            return -1;
+        return node;
+    }
+} // namespace bench
@@ -0,0 +1,155 @@
+// perf_counters.h - hardware event counts through perf_event_open, to check
+// what a benchmark actually did (which level it missed in, how many TLB
+// misses it took) instead of inferring it from the time alone.
+//
+// Counters are often unavailable: in containers and VMs without a virtual
+// PMU, or when /proc/sys/kernel/perf_event_paranoid forbids them. Each event
+// that fails to open is left out, and with none at all available() is false
+// and error() says why; callers print nothing extra in that case.
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace bench
+{
+    struct PerfEvent
+    {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+    };
+
+    constexpr uint64_t hw_cache(uint64_t cache, uint64_t op, uint64_t result)
+    {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    // cycles, instructions, L1D / LLC / dTLB read misses and branch misses
+    inline const std::vector<PerfEvent> &default_events()
+    {
+        static const std::vector<PerfEvent> events = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"l1d_miss", PERF_TYPE_HW_CACHE,
+             hw_cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"llc_miss", PERF_TYPE_HW_CACHE,
+             hw_cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"dtlb_miss", PERF_TYPE_HW_CACHE,
+             hw_cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"branch_miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+        return events;
+    }
+
+    // Counts events for this thread, and for threads it starts after the
+    // counters are opened, in user mode, between start() and stop()
+    class PerfCounters
+    {
+    public:
+        explicit PerfCounters(const std::vector<PerfEvent> &events = default_events())
+            : m_events{events}, m_fds(events.size(), -1), m_start(events.size()),
+              m_values(events.size(), NAN)
+        {
+            for (size_t i = 0; i < m_events.size(); ++i)
+            {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = m_events[i].type;
+                attr.config = m_events[i].config;
+                attr.disabled = 1;
+                attr.inherit = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                // Events outnumbering the hardware counters are time-multiplexed;
+                // these say for how long each one really counted
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                m_fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+                if (m_fds[i] < 0 && m_error.empty())
+                    m_error = std::string("perf_event_open(") + m_events[i].name + "): " + std::strerror(errno);
+            }
+        }
+
+        ~PerfCounters()
+        {
+            for (int fd : m_fds)
+                if (fd >= 0)
+                    close(fd);
+        }
+
+        PerfCounters(const PerfCounters &) = delete;
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+        // Whether any event could be opened
+        bool available() const
+        {
+            for (int fd : m_fds)
+                if (fd >= 0)
+                    return true;
+            return false;
+        }
+
+        // Why the first event that failed did
+        const std::string &error() const { return m_error; }
+
+        size_t size() const { return m_events.size(); }
+        const char *name(size_t i) const { return m_events[i].name; }
+        bool opened(size_t i) const { return m_fds[i] >= 0; }
+
+        // PERF_EVENT_IOC_RESET clears the count but not the enabled and
+        // running times, so all three are read here and stop() scales the
+        // differences
+        void start()
+        {
+            for (size_t i = 0; i < m_fds.size(); ++i)
+                if (m_fds[i] >= 0)
+                {
+                    ioctl(m_fds[i], PERF_EVENT_IOC_RESET, 0);
+                    ioctl(m_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+                    if (read(m_fds[i], m_start[i].data(), sizeof(m_start[i])) != sizeof(m_start[i]))
+                        m_start[i] = {};
+                }
+        }
+
+        void stop()
+        {
+            for (int fd : m_fds)
+                if (fd >= 0)
+                    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            for (size_t i = 0; i < m_fds.size(); ++i)
+            {
+                m_values[i] = NAN;
+                uint64_t buf[3]; // value, time enabled, time running
+                if (m_fds[i] < 0 || read(m_fds[i], buf, sizeof(buf)) != sizeof(buf))
+                    continue;
+                double count = double(buf[0] - m_start[i][0]);
+                double enabled = double(buf[1] - m_start[i][1]);
+                double running = double(buf[2] - m_start[i][2]);
+                // Never on a hardware counter: the count is unknown, not zero
+                if (running > 0)
+                    m_values[i] = count * enabled / running;
+            }
+        }
+
+        // Count of event i over the last start()..stop(); NAN when not opened
+        // or when the event was never scheduled onto a counter
+        double value(size_t i) const { return m_values[i]; }
+
+    private:
+        std::vector<PerfEvent> m_events;
+        std::vector<int> m_fds;
+        std::vector<std::array<uint64_t, 3>> m_start; // buf as read at start()
+        std::vector<double> m_values;
+        std::string m_error;
+    };
+} // namespace bench
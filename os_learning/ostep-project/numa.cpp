@@ -0,0 +1,217 @@
+#define _GNU_SOURCE
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "include/affinity.h"
+#include "include/cache_info.h"
+#include "include/bench.h"
+#include "include/chase.h"
+#include "include/numa.h"
+
+// Local versus remote memory. For every pair of (cpu node, memory node) the
+// buffer is bound to the memory node with mbind before it is touched, and
+// the test runs on cores of the cpu node:
+//   latency    a random pointer chase over the buffer (include/chase.h)
+//   bandwidth  the node's cores (up to -t) each summing their slice
+// and each becomes a node x node CSV matrix, rows the cpu node and columns
+// the memory node; the diagonal is local memory. Binding uses the raw mbind
+// syscall (include/numa.h), so libnuma isn't needed. On a single-node
+// machine both matrices are 1x1; boot with numa=fake=N to split memory into N
+// nodes and exercise the rest (every node then costs the same). Each cell
+// runs under the include/bench.h harness and the matrix has its median;
+// --json has the confidence intervals. The main thread moves to each cpu
+// node in turn, so the harness itself pins nothing.
+//
+// usage: numa [-s bytes] [-t threads_per_node] [-n loads] [-o out.csv]
+//             [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]
+
+using Clock = std::chrono::steady_clock;
+
+// Sums n doubles with four accumulators, so that the adds don't limit it
+double sum_slice(const double *a, size_t n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (size_t i = 0; i + 4 <= n; i += 4) {
+        s0 += a[i];
+        s1 += a[i + 1];
+        s2 += a[i + 2];
+        s3 += a[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+volatile double sum_sink;
+
+// bytes of doubles bound to mem_node, written once so every page is there
+double *bound_buffer(size_t bytes, int mem_node) {
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    bench::bind_memory(p, bytes, mem_node);
+    double *a = static_cast<double *>(p);
+    std::fill(a, a + bytes / sizeof(double), 1.0);
+    return a;
+}
+
+// Read GB/s of n doubles at a, one slice read by a thread on each of cores.
+// The readers are created and pinned first and released together through a
+// barrier, so the clock runs from the release to the last join and thread
+// start-up and migration aren't counted as reading.
+double read_bandwidth(const double *a, size_t n, const std::vector<int> &cores) {
+    size_t per = n / cores.size();
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, nullptr, cores.size() + 1);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < cores.size(); ++t)
+        threads.emplace_back([=, &start] {
+            bench::pin_current_thread(cores[t]);
+            pthread_barrier_wait(&start);
+            sum_sink = sum_slice(a + t * per, per);
+        });
+    pthread_barrier_wait(&start);
+    auto t0 = Clock::now();
+    for (auto &t : threads)
+        t.join();
+    double s = std::chrono::duration<double>(Clock::now() - t0).count();
+    pthread_barrier_destroy(&start);
+    return per * cores.size() * sizeof(double) / s / 1e9;
+}
+
+void print_matrix(FILE *out, const char *title, const std::vector<int> &nodes,
+                  const std::vector<std::vector<double>> &m) {
+    std::fprintf(out, "# %s (rows: cpu node, columns: memory node)\nnode", title);
+    for (int n : nodes)
+        std::fprintf(out, ",%d", n);
+    std::fprintf(out, "\n");
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        std::fprintf(out, "%d", nodes[i]);
+        for (size_t j = 0; j < nodes.size(); ++j) {
+            if (m[i][j] < 0)
+                std::fprintf(out, ",");
+            else
+                std::fprintf(out, ",%.2f", m[i][j]);
+        }
+        std::fprintf(out, "\n");
+    }
+    std::fprintf(out, "\n");
+    std::fflush(out);
+}
+
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.warmup = 1;
+    opts.reps = 5;
+    opts = bench::parse_args(argc, argv, opts);
+
+    size_t bytes = 0;
+    int max_threads = 0;
+    long long loads = 1LL << 22;
+    const char *out_path = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:n:o:")) != -1) {
+        switch (opt) {
+        case 's': bytes = std::strtoull(optarg, nullptr, 0); break;
+        case 't': max_threads = std::atoi(optarg); break;
+        case 'n': loads = std::max(8LL, std::atoll(optarg)); break;
+        case 'o': out_path = optarg; break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [-s bytes] [-t threads_per_node] [-n loads] [-o out.csv]"
+                         " [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<int> nodes = bench::numa_nodes();
+    std::vector<int> usable = bench::usable_cores();
+    auto caches = bench::discover_caches(usable.empty() ? 0 : usable[0]);
+    const size_t line = bench::line_size(caches);
+    if (bytes == 0)
+        bytes = 4 * bench::llc_size(caches);   // well past the caches
+
+    // Before any reader thread, so the counters follow them
+    opts.cpu = -1;
+    bench::Harness h("numa", opts);
+
+    FILE *out = out_path ? std::fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    std::fprintf(out, "# %zu node(s), %zu MiB per test\n", nodes.size(), bytes >> 20);
+    if (nodes.size() == 1)
+        std::fprintf(out, "# single node: only local memory to measure (numa=fake=N splits it)\n");
+
+    // -1 marks a node with no cpu we may use (e.g. a memory-only node)
+    const size_t n = nodes.size();
+    std::vector<std::vector<double>> latency(n, std::vector<double>(n, -1));
+    std::vector<std::vector<double>> bandwidth(n, std::vector<double>(n, -1));
+    for (size_t c = 0; c < n; ++c) {
+        // Cores of node c we may run on, one per physical core
+        std::vector<int> cpus = bench::node_cpus(nodes[c]), cores;
+        for (int cpu : usable)
+            if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+                cores.push_back(cpu);
+        if (cores.empty()) {
+            std::fprintf(out, "# node %d: no usable cpus\n", nodes[c]);
+            continue;
+        }
+        if (max_threads > 0 && (int)cores.size() > max_threads)
+            cores.resize(max_threads);
+        bench::pin_current_thread(cores[0]);
+
+        for (size_t m = 0; m < n; ++m) {
+            bench::Chase chase(bytes);
+            // Without NUMA support mbind fails; one node is still worth measuring
+            if (!bench::bind_memory(chase.base(), chase.capacity(), nodes[m]) && n > 1)
+                continue;
+            chase.link(bytes, line, bench::ChaseOrder::Random);
+            int landed = bench::node_of(chase.head());
+            if (landed != nodes[m] && nodes.size() > 1)
+                std::fprintf(out, "# warning: memory for node %d landed on node %d\n", nodes[m], landed);
+            const std::string cell = std::to_string(nodes[c]) + "/" + std::to_string(nodes[m]);
+            long long steps = std::max<long long>(loads, 2 * (long long)chase.nodes());
+            latency[c][m] = h.per(steps).measure("latency/" + cell, "ns",
+                                                 [&] { return chase.ns_per_load(steps, 1, false); }).median;
+
+            double *a = bound_buffer(bytes, nodes[m]);
+            const size_t doubles = bytes / sizeof(double);
+            bandwidth[c][m] = h.per(bytes / line).measure("bandwidth/" + cell, "GB/s",
+                                                          [&] { return read_bandwidth(a, doubles, cores); }).median;
+            munmap(a, bytes);
+        }
+    }
+
+    print_matrix(out, "latency, ns per load", nodes, latency);
+    print_matrix(out, "read bandwidth, GB/s", nodes, bandwidth);
+
+    // Remote over local, averaged over the pairs that were measured
+    double ratio_lat = 0, ratio_bw = 0;
+    int pairs = 0;
+    for (size_t c = 0; c < n; ++c)
+        for (size_t m = 0; m < n; ++m)
+            if (c != m && latency[c][m] > 0 && latency[c][c] > 0) {
+                ratio_lat += latency[c][m] / latency[c][c];
+                ratio_bw += bandwidth[c][m] / bandwidth[c][c];
+                ++pairs;
+            }
+    if (pairs)
+        std::fprintf(out, "# remote/local: latency %.2fx, bandwidth %.2fx\n",
+                     ratio_lat / pairs, ratio_bw / pairs);
+
+    if (out != stdout)
+        std::fclose(out);
+    h.finish();
+    return 0;
+}
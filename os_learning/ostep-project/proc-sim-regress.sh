@@ -0,0 +1,27 @@
+#!/bin/sh
+# Regression runs for proc-sim's paging, built with ASan and UBSan: memory
+# so small that the processes faulting at once outnumber the frames, so a
+# fault can find every frame held for another page-in, under every
+# replacement policy. Each run has to finish, cleanly, within the timeout.
+#
+# usage: ./proc-sim-regress.sh   (from this directory)
+set -u
+bin=${TMPDIR:-/tmp}/proc-sim-regress
+g++ -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all -o "$bin" proc-sim.cpp || exit 1
+
+fail=0
+for e in fifo lru clock arc ws; do
+    for args in "-s 1 -L 4 -f 32 -n 200" \
+                "-s 1 -L 4 -f 32 -c 4 -n 200" \
+                "-s 1 -L 4 -f 2 -c 4 -n 8" \
+                "-s 1 -L 4 -f 1 -c 2 -n 6 -p mlfq -i 0.5 -k 3"; do
+        if timeout 300 "$bin" $args -e "$e" > /dev/null; then
+            echo "ok    -e $e $args"
+        else
+            echo "FAIL  -e $e $args (exit $?)"
+            fail=1
+        fi
+    done
+done
+rm -f "$bin"
+exit $fail
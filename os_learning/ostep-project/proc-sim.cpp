@@ -1,11 +1,63 @@
-
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <queue>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <string>
+#include <memory>
+#include <functional>
+#include <optional>
 #include <random>
 #include <chrono>
-#include <thread>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <ctime>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+
+#include "include/affinity.h"
+
+// Simulated time, in ms. Nothing sleeps: the clock jumps from one event to
+// the next, so a run costs the events it handles, not the time it simulates.
+using Time = int64_t;
+
+// Linux's weights for nice -20..19 (sched_prio_to_weight): each step is
+// about 10% more or less CPU, and nice 0 is 1024
+const int nice_weights[40] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+    9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+    1024,  820,   655,   526,   423,   335,   272,   215,   172,   137,
+    110,   87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+int nice_weight(int nice) { return nice_weights[std::clamp(nice, -20, 19) + 20]; }
+
+// The nice whose weight is closest to weight
+int weight_nice(int weight) {
+    int best = 0;
+    for (int n = -20; n < 20; ++n)
+        if (std::abs(nice_weight(n) - weight) < std::abs(nice_weight(best) - weight)) best = n;
+    return best;
+}
 
 // Enum for process states (OSTEP Chapter 13)
 enum class ProcessState { READY, RUNNING, BLOCKED, TERMINATED };
@@ -16,18 +68,29 @@ public:
     int pid;                    // Unique process ID
     ProcessState state;         // Current state
     int burst_time;             // Total CPU time needed (ms)
-    int remaining_time;         // Remaining CPU time
+    int remaining_time;         // Remaining CPU time in the current burst
     uint32_t pc;                // Program counter (simulated)
     uint32_t base, bound;       // Base/bound registers (Chapter 16)
-    int arrival_time;           // Time process enters system
-    int completion_time;        // Time process finishes
-    int waiting_time;           // Time spent in ready queue
+    Time arrival_time;          // Time process enters system
+    Time completion_time;       // Time process finishes
+    Time waiting_time;          // Time spent in ready queue
+    Time first_run;             // Time first dispatched, -1 before
+    Time enqueued_at;           // When it last joined a run queue
+    int rq_prev, rq_next;       // Run queue links (indices), -1 at the ends
+    int weight;                 // CPU share: CFS weight, lottery tickets, stride (1024 = nice 0)
+    bool interactive;           // Latency-sensitive rather than batch (for reporting)
+    int cpu;                    // CPU it last ran on (its cache is warm there), -1 before
+    std::vector<int> bursts;    // After the first CPU burst: I/O, CPU, I/O, ..., CPU (ms)
+    size_t next_burst;          // Next of bursts
+    int swap_wait;              // Blocked on a page fault: the swap device time it needs
 
     // Constructor: Initialize with PID and random burst time
-    Process(int id, int burst, int arrival)
+    Process(int id, int burst, Time arrival, int weight = 1024, bool interactive = false)
         : pid(id), state(ProcessState::READY), burst_time(burst),
           remaining_time(burst), pc(0), base(0), bound(2048), // Example: 2 KB bound
-          arrival_time(arrival), completion_time(0), waiting_time(0) {
+          arrival_time(arrival), completion_time(0), waiting_time(0), first_run(-1),
+          enqueued_at(0), rq_prev(-1), rq_next(-1), weight(weight), interactive(interactive), cpu(-1),
+          next_burst(0), swap_wait(0) {
         base = 16384 + (rand() % 16384); // Random base in 16 KB range
     }
 
@@ -37,142 +100,2474 @@ public:
         remaining_time -= time_slice;
         pc += time_slice * 10; // Simulate PC increment
         if (remaining_time <= 0) {
-            state = ProcessState::TERMINATED;
+            state = next_burst < bursts.size() ? ProcessState::BLOCKED : ProcessState::TERMINATED;
             remaining_time = 0;
         }
     }
 
+    // Appends an I/O burst and the CPU burst after it
+    void add_io(int io_time, int cpu_time) {
+        bursts.push_back(io_time);
+        bursts.push_back(cpu_time);
+        burst_time += cpu_time;
+    }
+
+    // Blocked: how long its I/O takes
+    int start_io() { return bursts[next_burst++]; }
+
+    // I/O done: on to the next CPU burst
+    void end_io() {
+        remaining_time = bursts[next_burst++];
+        state = ProcessState::READY;
+    }
+
     // Rule of Three: Destructor, copy constructor, assignment operator
     ~Process() = default;
     Process(const Process&) = default;
     Process& operator=(const Process&) = default;
 };
 
-// MMU class: Simulates address translation (OSTEP Chapters 15–16)
+// A run of references to one 4 KiB page, from a memory-access trace
+struct PageRef {
+    uint64_t page;              // Virtual address >> 12
+    uint32_t count;             // References in the run
+    bool write;                 // Any of them a store
+};
+
+// Reads a memory-access trace into runs of references to the same page:
+// valgrind --tool=lackey --trace-mem=yes output ("I  0400d7d4,8",
+// " S 7ff000398,8", " L ...", " M ..."), or one hex address per line with
+// an optional R/W after it. Every process replays it from its own place.
+std::shared_ptr<const std::vector<PageRef>> load_ref_trace(const std::string& path) {
+    FILE* in = std::fopen(path.c_str(), "r");
+    if (!in) throw std::runtime_error(path + ": " + std::strerror(errno));
+    auto refs = std::make_shared<std::vector<PageRef>>();
+    char* line = nullptr;
+    size_t cap = 0;
+    while (getline(&line, &cap, in) > 0) {
+        const char* p = line;
+        while (*p == ' ') ++p;
+        bool write = false;
+        if (*p && std::strchr("ILSM", *p) && p[1] == ' ') {
+            write = *p == 'S' || *p == 'M';
+            p += 2;
+        }
+        char* end;
+        uint64_t addr = std::strtoull(p, &end, 16);
+        if (end == p) continue;     // Valgrind's banner, blank lines
+        while (*end == ' ') ++end;
+        if (*end == 'W' || *end == 'w') write = true;
+        uint64_t page = addr >> 12;
+        if (!refs->empty() && refs->back().page == page && refs->back().count < UINT32_MAX) {
+            ++refs->back().count;
+            refs->back().write |= write;
+        } else {
+            refs->push_back(PageRef{page, 1, write});
+        }
+    }
+    std::free(line);
+    std::fclose(in);
+    if (refs->empty()) throw std::runtime_error(path + ": no memory references");
+    return refs;
+}
+
+// Paging configuration (OSTEP Chapters 18–20). Page tables are radix trees
+// of 512 eight-byte entries per 4 KiB node, as on x86-64 and RISC-V: 2
+// levels map 30 bits of virtual address, 3 levels 39 and 4 levels 48. A
+// 2 MiB or 1 GiB page is a leaf one or two levels up, so its walk is
+// shorter.
+struct PagingConfig {
+    int levels = 0;             // Page table levels, 2–4; 0: no paging simulation
+    int page_shift = 12;        // 12, 21 or 30: 4 KiB, 2 MiB or 1 GiB pages
+    int tlb_sets = 16;          // Per CPU
+    int tlb_ways = 4;
+    bool asid = true;           // Tag TLB entries by address space; false: flush on switch out
+    int max_asids = 4096;       // x86 PCIDs are 12 bits
+    int refs_per_ms = 50;       // Memory references a process makes per ms of CPU
+
+    // Physical memory (OSTEP Chapters 21–22)
+    int frames = 0;             // Page frames; 0: as many as needed
+    std::string replacement = "clock";  // fifo, lru, clock, arc or ws
+    int swap_ms = 5;            // Swap device time to read or write a page
+    int ws_window_ms = 100;     // Working-set window, in ms of references
+    std::shared_ptr<const std::vector<PageRef>> refs;   // Memory-access trace; null: synthetic
+
+    int walk_depth() const { return levels - (page_shift - 12) / 9; }
+};
+
+// What the paging MMU saw over a run
+struct PagingStats {
+    uint64_t accesses = 0;
+    uint64_t tlb_hits = 0;
+    uint64_t walks = 0;         // TLB misses, each a page walk
+    uint64_t compulsory = 0;    // Walks that found no mapping and made one
+    uint64_t walk_refs = 0;     // Memory references the walks made
+    uint64_t switches = 0;      // Page table loads: every dispatch without ASIDs,
+                                // else only a change of address space
+    uint64_t flushes = 0;       // Whole-TLB flushes
+    uint64_t rollovers = 0;     // Times the ASIDs ran out
+    uint64_t major_faults = 0;  // Page read back from swap
+    uint64_t evictions = 0;
+    uint64_t writebacks = 0;    // Evicted dirty pages written to swap
+    uint64_t resident = 0;      // Pages in memory now
+    uint64_t peak_resident = 0;
+};
+
+// Set-associative TLB with LRU replacement within a set, entries tagged
+// with an address space ID
+class Tlb {
+    struct Entry {
+        uint64_t vpn = 0;
+        uint32_t asid = 0;
+        uint32_t used = 0;      // LRU stamp, 0: invalid
+    };
+    std::vector<Entry> entries;
+    uint64_t set_mask;
+    int ways;
+    uint32_t clock = 0;
+
+public:
+    Tlb(int sets, int ways) : entries(size_t(sets) * ways), set_mask(sets - 1), ways(ways) {}
+
+    // Whether (asid, vpn) is cached; refreshes it when it is
+    bool lookup(uint32_t asid, uint64_t vpn) {
+        Entry* set = &entries[(vpn & set_mask) * ways];
+        for (int w = 0; w < ways; ++w)
+            if (set[w].used && set[w].vpn == vpn && set[w].asid == asid) {
+                set[w].used = ++clock;
+                return true;
+            }
+        return false;
+    }
+
+    void insert(uint32_t asid, uint64_t vpn) {
+        Entry* set = &entries[(vpn & set_mask) * ways];
+        Entry* victim = set;
+        for (int w = 1; w < ways && victim->used; ++w)
+            if (set[w].used < victim->used) victim = &set[w];
+        *victim = Entry{vpn, asid, ++clock};
+    }
+
+    // Shootdown of one translation, when its page is evicted
+    void invalidate(uint32_t asid, uint64_t vpn) {
+        Entry* set = &entries[(vpn & set_mask) * ways];
+        for (int w = 0; w < ways; ++w)
+            if (set[w].vpn == vpn && set[w].asid == asid) set[w].used = 0;
+    }
+
+    void flush() {
+        for (Entry& e : entries) e.used = 0;
+    }
+};
+
+// Doubly linked list of page frames through per-frame links, so moving a
+// frame to the back (LRU) or unlinking it is O(1)
+class FrameList {
+    std::vector<int> prev, next;
+    int head = -1, tail = -1;
+    size_t count = 0;
+
+public:
+    explicit FrameList(int frames = 0) : prev(frames, -1), next(frames, -1) {}
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    int front() const { return head; }
+
+    void push_back(int f) {
+        prev[f] = tail;
+        next[f] = -1;
+        if (tail >= 0) next[tail] = f;
+        else head = f;
+        tail = f;
+        ++count;
+    }
+
+    void remove(int f) {
+        if (prev[f] >= 0) next[prev[f]] = next[f];
+        else head = next[f];
+        if (next[f] >= 0) prev[next[f]] = prev[f];
+        else tail = prev[f];
+        --count;
+    }
+
+    int pop_front() {
+        int f = head;
+        remove(f);
+        return f;
+    }
+};
+
+// Page replacement policy (OSTEP Chapter 22): which resident page goes
+// when memory is full. It sees frames 0..frames-1; a page keeps its key
+// (address space and virtual page) across evictions, for ARC's history.
+// "now" counts memory references. Successive references to one page count
+// as one use.
+class ReplacementPolicy {
+public:
+    virtual ~ReplacementPolicy() = default;
+    virtual const char* name() const = 0;
+    virtual void inserted(int frame, uint64_t key, uint64_t now) = 0;
+    virtual void accessed(int frame, uint64_t now) = 0;
+    virtual void removed(int frame) = 0;            // Freed: its process exited
+    // Choose a frame to evict to make room for page incoming, and forget it
+    virtual int victim(uint64_t incoming, uint64_t now) = 0;
+};
+
+// Evicts the page loaded longest ago, however much it is used
+class FifoReplacement : public ReplacementPolicy {
+protected:
+    FrameList order;
+
+public:
+    explicit FifoReplacement(int frames) : order(frames) {}
+    const char* name() const override { return "fifo"; }
+    void inserted(int frame, uint64_t, uint64_t) override { order.push_back(frame); }
+    void accessed(int, uint64_t) override {}
+    void removed(int frame) override { order.remove(frame); }
+    int victim(uint64_t, uint64_t) override { return order.pop_front(); }
+};
+
+// Evicts the page used longest ago: FIFO, moving a page to the back on use
+class LruReplacement : public FifoReplacement {
+public:
+    using FifoReplacement::FifoReplacement;
+    const char* name() const override { return "lru"; }
+    void accessed(int frame, uint64_t) override {
+        order.remove(frame);
+        order.push_back(frame);
+    }
+};
+
+// Clock (second chance): the hand sweeps the frames, clearing use bits,
+// and evicts the first page whose bit is already clear
+class ClockReplacement : public ReplacementPolicy {
+    std::vector<char> used, present;
+    size_t hand = 0;
+
+public:
+    explicit ClockReplacement(int frames) : used(frames, 0), present(frames, 0) {}
+    const char* name() const override { return "clock"; }
+    void inserted(int frame, uint64_t, uint64_t) override { used[frame] = present[frame] = 1; }
+    void accessed(int frame, uint64_t) override { used[frame] = 1; }
+    void removed(int frame) override { present[frame] = 0; }
+    int victim(uint64_t, uint64_t) override {
+        for (;; hand = (hand + 1) % used.size()) {
+            if (!present[hand]) continue;
+            if (used[hand]) {
+                used[hand] = 0;
+                continue;
+            }
+            present[hand] = 0;
+            int frame = int(hand);
+            hand = (hand + 1) % used.size();
+            return frame;
+        }
+    }
+};
+
+// Working set (Denning, as WSClock sweeps it): evicts a page not used in
+// the last window references, the first the hand finds; when every page
+// is in some working set, the least recently used one
+class WorkingSetReplacement : public ReplacementPolicy {
+    std::vector<uint64_t> last_use;
+    std::vector<char> present;
+    uint64_t window;
+    size_t hand = 0;
+
+public:
+    WorkingSetReplacement(int frames, uint64_t window)
+        : last_use(frames, 0), present(frames, 0), window(window) {}
+    const char* name() const override { return "ws"; }
+    void inserted(int frame, uint64_t, uint64_t now) override {
+        present[frame] = 1;
+        last_use[frame] = now;
+    }
+    void accessed(int frame, uint64_t now) override { last_use[frame] = now; }
+    void removed(int frame) override { present[frame] = 0; }
+    int victim(uint64_t, uint64_t now) override {
+        int oldest = -1;
+        for (size_t i = 0; i < present.size(); ++i, hand = (hand + 1) % present.size()) {
+            if (!present[hand]) continue;
+            if (now - last_use[hand] > window) {
+                oldest = hand;
+                break;
+            }
+            if (oldest < 0 || last_use[hand] < last_use[oldest]) oldest = hand;
+        }
+        present[oldest] = 0;
+        return oldest;
+    }
+};
+
+// Adaptive replacement cache (Megiddo and Modha, FAST '03): t1 holds pages
+// used once lately, t2 pages used more than that, both in LRU order, and
+// b1/b2 remember the keys of pages recently evicted from each. A fault on
+// a page in b1 means t1 was too small, so the target size p of t1 grows;
+// one in b2 shrinks it. Pages coming back from either ghost list go to t2.
+class ArcReplacement : public ReplacementPolicy {
+    struct Ghost {
+        int list;                       // 1 or 2
+        std::list<uint64_t>::iterator pos;
+    };
+    size_t c;
+    double p = 0;
+    FrameList t1, t2;
+    std::vector<char> in_t2;            // Per frame
+    std::vector<uint64_t> key_of;       // Per frame
+    std::list<uint64_t> b1, b2;         // Least recent at the front
+    std::unordered_map<uint64_t, Ghost> ghosts;
+    uint64_t adapted = UINT64_MAX;      // Key victim() already adapted p for
+
+    int ghost_list(uint64_t key) const {
+        auto g = ghosts.find(key);
+        return g == ghosts.end() ? 0 : g->second.list;
+    }
+
+    void adapt(uint64_t key) {
+        double n1 = b1.size(), n2 = b2.size();
+        switch (ghost_list(key)) {
+        case 1: p = std::min<double>(c, p + std::max(1.0, n2 / n1)); break;
+        case 2: p = std::max(0.0, p - std::max(1.0, n1 / n2)); break;
+        }
+    }
+
+    void forget_oldest(std::list<uint64_t>& b) {
+        ghosts.erase(b.front());
+        b.pop_front();
+    }
+
+public:
+    explicit ArcReplacement(int frames)
+        : c(frames), t1(frames), t2(frames), in_t2(frames, 0), key_of(frames, 0) {}
+    const char* name() const override { return "arc"; }
+
+    void inserted(int frame, uint64_t key, uint64_t) override {
+        if (key != adapted) adapt(key);
+        adapted = UINT64_MAX;
+        key_of[frame] = key;
+        auto g = ghosts.find(key);
+        if (g != ghosts.end()) {
+            (g->second.list == 1 ? b1 : b2).erase(g->second.pos);
+            ghosts.erase(g);
+            in_t2[frame] = 1;
+            t2.push_back(frame);
+        } else {
+            in_t2[frame] = 0;
+            t1.push_back(frame);
+        }
+        // History is bounded: t1 + b1 by c, everything by 2c
+        while (t1.size() + b1.size() > c && !b1.empty()) forget_oldest(b1);
+        while (t1.size() + t2.size() + b1.size() + b2.size() > 2 * c && !b2.empty()) forget_oldest(b2);
+    }
+
+    void accessed(int frame, uint64_t) override {
+        (in_t2[frame] ? t2 : t1).remove(frame);
+        in_t2[frame] = 1;
+        t2.push_back(frame);
+    }
+
+    void removed(int frame) override { (in_t2[frame] ? t2 : t1).remove(frame); }
+
+    int victim(uint64_t incoming, uint64_t) override {
+        adapt(incoming);
+        adapted = incoming;
+        bool from_t1 = !t1.empty() &&
+                       (t2.empty() || t1.size() > p || (ghost_list(incoming) == 2 && t1.size() == size_t(p)));
+        int frame = (from_t1 ? t1 : t2).pop_front();
+        auto& b = from_t1 ? b1 : b2;
+        b.push_back(key_of[frame]);
+        ghosts[key_of[frame]] = Ghost{from_t1 ? 1 : 2, std::prev(b.end())};
+        return frame;
+    }
+};
+
+const char* const replacement_names[] = {"fifo", "lru", "clock", "arc", "ws"};
+
+std::unique_ptr<ReplacementPolicy> make_replacement(const std::string& name, int frames, uint64_t window) {
+    if (name == "fifo") return std::make_unique<FifoReplacement>(frames);
+    if (name == "lru") return std::make_unique<LruReplacement>(frames);
+    if (name == "clock") return std::make_unique<ClockReplacement>(frames);
+    if (name == "arc") return std::make_unique<ArcReplacement>(frames);
+    if (name == "ws") return std::make_unique<WorkingSetReplacement>(frames, window);
+    return nullptr;
+}
+
+// MMU class: Simulates address translation (OSTEP Chapters 18–20) through
+// per-process multi-level page tables and a TLB per CPU, over a limited
+// pool of page frames backed by swap (Chapters 21–22). A page is mapped on
+// first touch; when no frame is free the replacement policy evicts one,
+// written to swap first if dirty, and touching it again is a major fault
+// that reads it back.
+//
+// A context switch is the save_state/restore_state pair: save_state drops
+// the outgoing process's TLB entries when they aren't ASID-tagged, and
+// restore_state loads the incoming page table and hands out ASIDs,
+// flushing every TLB when a generation of them runs out.
+//
+// References come from a memory-access trace, or else are synthetic: each
+// process has a working set of 64 KiB to 1 MiB split into code, heap and
+// stack regions. It stays on one page for 9 references in 10, and
+// otherwise jumps, usually to one of 8 hot pages and sometimes to anywhere
+// in its working set; 3 in 10 references are stores.
 class MMU {
+    // One process's address space; indexed by process slot
+    struct AddressSpace {
+        int64_t root = -1;          // Top page table node, -1 before first use
+        uint64_t id = 0;            // Unique over the run, for replacement keys
+        uint64_t pages = 0;         // Working set, in pages (synthetic references)
+        uint64_t page = 0;          // Page of the last reference, 0..pages-1
+        size_t cursor = 0;          // Place in the reference trace
+        uint32_t done_in_run = 0;   // References of the trace's current run made
+        uint64_t spare_refs = 0;    // Made towards a ms a fault cut short
+        uint64_t last_vpn = UINT64_MAX;
+        uint32_t asid = 0;
+        uint64_t asid_gen = 0;      // Generation asid was handed out in, 0: none
+        int64_t fault_frame = -1;   // Held for a page-in in progress, -1: none
+        uint64_t fault_vpn = 0;     // The page it is for
+        bool fault_major = false;   // Read back from swap, not first touch
+    };
+
+    // Page table entry values: frame + 1 when resident
+    static constexpr int64_t UNMAPPED = 0, SWAPPED = -1;
+
+    struct Frame {
+        int space;                  // Slot of the process it belongs to
+        uint64_t vpn;
+        bool dirty;
+    };
+
+    PagingConfig config;
+    std::vector<std::vector<int64_t>> nodes;    // Page table nodes: child node + 1, or a PTE at the leaves
+    std::vector<int64_t> free_nodes;
+    std::vector<AddressSpace> spaces;
+    std::vector<Tlb> tlbs;                      // Per CPU
+    std::vector<int> loaded;                    // Per CPU, slot whose page table is loaded, -1 before
+    std::vector<Frame> frames;                  // When memory is limited
+    std::vector<int> free_frames;
+    std::unique_ptr<ReplacementPolicy> replacement;
+    uint32_t next_asid = 1;
+    uint64_t asid_gen = 1;
+    uint64_t next_space_id = 1;
+    int64_t next_frame = 0;                     // When unlimited
+    std::mt19937_64 rng;
+    PagingStats stats;
+
 public:
-    // Translate virtual address to physical (simulates segmentation)
-    uint32_t translate(const Process& proc, uint16_t virt_addr) {
-        // Extract segment ID and offset (e.g., 14-bit address, 2-bit ID)
-        uint8_t seg_id = (virt_addr >> 12) & 0x3; // 2-bit segment ID
-        uint16_t offset = virt_addr & 0xFFF;      // 12-bit offset
-        if (offset >= proc.bound) throw std::runtime_error("Segmentation fault");
-        // Simulate downward-growing stack for segment ID 2 (your stack example)
-        bool grows_down = (seg_id == 2);
-        return grows_down ? proc.base - offset : proc.base + offset;
+    // Stall of a fault that found every frame held for other page-ins:
+    // nothing to evict, so it waits for one of them to finish
+    static constexpr int NO_FRAME = -1;
+
+    MMU(const PagingConfig& config = {}, int ncpus = 1)
+        : config(config), tlbs(config.levels ? ncpus : 0, Tlb(config.tlb_sets, config.tlb_ways)),
+          loaded(ncpus, -1), frames(config.frames), rng(42) {
+        if (config.frames > 0) {
+            replacement = make_replacement(config.replacement, config.frames,
+                                           uint64_t(config.ws_window_ms) * config.refs_per_ms);
+            if (!replacement) throw std::runtime_error("unknown replacement policy " + config.replacement);
+            for (int f = config.frames - 1; f >= 0; --f) free_frames.push_back(f);
+        }
     }
 
-    // Save process state (context switch)
-    void save_state(Process& proc) {
-        //TODO: Save PC and base/bound (placeholder)
+    bool enabled() const { return config.levels > 0; }
+    const PagingConfig& paging() const { return config; }
+    const PagingStats& paging_stats() const { return stats; }
+    const char* replacement_name() const { return replacement ? replacement->name() : "none"; }
+
+    // Translate virtual address of the process in slot idx, running on cpu,
+    // to physical: through the TLB, or a page walk when it misses. count
+    // references in a row to the same page are made at once. Returns the
+    // ms the process has to wait for swap, 0 if none; the page is mapped
+    // when that is over (page_in_done) and the reference is made again.
+    int translate(int cpu, int idx, uint64_t virt_addr, bool write, uint32_t count = 1) {
+        AddressSpace& as = spaces[idx];
+        uint64_t vpn = (virt_addr >> config.page_shift) & (va_size() / page_size() - 1);
+        uint32_t asid = config.asid ? as.asid : 0;
+        bool loaded = false;    // Paged in by this reference: not a reuse
+        if (tlbs[cpu].lookup(asid, vpn)) {
+            ++stats.tlb_hits;
+        } else {
+            if (int stall = walk(idx, as, vpn, loaded)) return stall;
+            tlbs[cpu].insert(asid, vpn);
+        }
+        stats.accesses += count;
+        stats.tlb_hits += count - 1;
+        if (replacement) {
+            int frame = int(leaf(as, vpn) - 1);
+            if (vpn != as.last_vpn && !loaded) replacement->accessed(frame, stats.accesses);
+            frames[frame].dirty |= write;
+        }
+        as.last_vpn = vpn;
+        return 0;
     }
 
-    // Restore process state
-    void restore_state(const Process& proc) {
-        //TODO: Restore PC and base/bound (placeholder)
+    // The process in slot idx is about to run for up to ms on cpu: make its
+    // memory references. Returns how many ms it gets through before a fault
+    // that waits for swap, and that wait in stall_ms (0: it ran them all;
+    // NO_FRAME: it has to wait for a frame first).
+    int run(int cpu, int idx, int ms, int& stall_ms) {
+        stall_ms = 0;
+        if (!enabled()) return ms;
+        AddressSpace& as = spaces[idx];
+        // References made before a fault last time count towards this
+        // slice's first ms, or a process faulting early in every slice
+        // would never get anywhere
+        const uint64_t budget = uint64_t(ms) * config.refs_per_ms;
+        for (uint64_t done = std::exchange(as.spare_refs, 0); done < budget; ) {
+            uint64_t addr;
+            bool write;
+            uint32_t count;
+            if (config.refs) {
+                const PageRef& ref = (*config.refs)[as.cursor];
+                addr = ref.page << 12;
+                write = ref.write;
+                count = uint32_t(std::min<uint64_t>(ref.count - as.done_in_run, budget - done));
+            } else {
+                if (rng() % 10 == 0) {
+                    // Mostly to one of 8 hot pages spread over the regions
+                    as.page = rng() % 10 ? (rng() % 8) * as.pages / 8 : rng() % as.pages;
+                }
+                addr = address_of(as, as.page) + rng() % page_size();
+                write = rng() % 10 < 3;
+                count = 1;
+            }
+            stall_ms = translate(cpu, idx, addr, write, count);
+            if (stall_ms) {
+                as.spare_refs = done % config.refs_per_ms;
+                return int(done / config.refs_per_ms);
+            }
+            done += count;
+            if (config.refs && (as.done_in_run += count) == (*config.refs)[as.cursor].count) {
+                as.done_in_run = 0;
+                as.cursor = (as.cursor + 1) % config.refs->size();
+            }
+        }
+        return ms;
     }
+
+    // Save process state: the process in slot idx comes off cpu. Without
+    // ASIDs its TLB entries can't be told from the next process's, so they
+    // go now, and nothing counts as loaded: the page table is reloaded on
+    // every switch, as xv6 does. With ASIDs they stay, and the CPU keeps
+    // the outgoing space as loaded so a rollover renumbers rather than
+    // reuses its ASID.
+    void save_state(int cpu, int idx) {
+        if (!enabled()) return;
+        if (!config.asid) {
+            tlbs[cpu].flush();
+            ++stats.flushes;
+            loaded[cpu] = -1;
+        } else {
+            loaded[cpu] = idx;
+        }
+    }
+
+    // Restore process state: load the page table of the process in slot idx
+    // on cpu, giving it an ASID if it has none in the current generation
+    void restore_state(int cpu, int idx, const Process& proc) {
+        if (!enabled() || loaded[cpu] == idx) return;
+        loaded[cpu] = idx;
+        ++stats.switches;
+        if (size_t(idx) >= spaces.size()) spaces.resize(idx + 1);
+        AddressSpace& as = spaces[idx];
+        if (as.root < 0) {
+            as.root = alloc_node();
+            as.id = next_space_id++;
+            // 64 KiB << 0..4, by pid
+            uint64_t bytes = uint64_t(64 << 10) << ((uint32_t(proc.pid) * 2654435761u >> 16) % 5);
+            as.pages = std::max<uint64_t>(3, bytes >> config.page_shift);
+            as.page = 0;
+            // Replaying the trace, each process starts somewhere else in it
+            if (config.refs) as.cursor = (uint64_t(proc.pid) * 2654435761u) % config.refs->size();
+        }
+        if (config.asid && as.asid_gen != asid_gen) {
+            // New ASID; when they run out, start a new generation, which
+            // needs every TLB flushed
+            if (next_asid == uint32_t(config.max_asids)) {
+                ++asid_gen;
+                next_asid = 1;
+                ++stats.rollovers;
+                for (Tlb& tlb : tlbs) tlb.flush();
+                stats.flushes += tlbs.size();
+                // What the other CPUs are running keeps going: renumber it
+                // into the new generation, as Linux reserves active ASIDs
+                for (size_t c = 0; c < loaded.size(); ++c)
+                    if (int(c) != cpu && loaded[c] >= 0) {
+                        spaces[loaded[c]].asid = next_asid++;
+                        spaces[loaded[c]].asid_gen = asid_gen;
+                    }
+            }
+            as.asid = next_asid++;
+            as.asid_gen = asid_gen;
+        }
+    }
+
+    // The swap device has done the page-in the process in slot idx faulted
+    // on: map the page, and only now count the fault
+    void page_in_done(int idx) {
+        if (size_t(idx) >= spaces.size() || spaces[idx].fault_frame < 0) return;
+        AddressSpace& as = spaces[idx];
+        map(idx, as, as.fault_vpn, std::exchange(as.fault_frame, -1), as.fault_major);
+        // The retried reference is the one that brought it in, not a reuse
+        as.last_vpn = as.fault_vpn;
+    }
+
+    // The process in slot idx was preempted before the fault its slice was
+    // to end in: the page stays out and the frame held for it is free
+    // again. A victim evicted to make room stays evicted. Returns whether
+    // there was a frame to free.
+    bool cancel_fault(int idx) {
+        if (size_t(idx) >= spaces.size() || spaces[idx].fault_frame < 0) return false;
+        free_frames.push_back(int(std::exchange(spaces[idx].fault_frame, -1)));
+        return true;
+    }
+
+    // The process in slot idx has exited: free its frames and page tables
+    void release(int idx) {
+        if (!enabled() || size_t(idx) >= spaces.size()) return;
+        cancel_fault(idx);
+        AddressSpace& as = spaces[idx];
+        if (as.root >= 0) free_tree(as.root, config.walk_depth());
+        as = AddressSpace{};
+        for (int& l : loaded)
+            if (l == idx) l = -1;
+    }
+
+private:
+    uint64_t page_size() const { return uint64_t(1) << config.page_shift; }
+    uint64_t va_size() const { return uint64_t(1) << (12 + 9 * config.levels); }
+
+    // Code at 1/64 of the address space, heap at 1/4, stack at the top
+    uint64_t address_of(const AddressSpace& as, uint64_t page) const {
+        const uint64_t code = as.pages / 4, heap = as.pages / 2;
+        uint64_t base;
+        if (page < code) base = va_size() / 64;
+        else if (page < code + heap) base = va_size() / 4, page -= code;
+        else base = va_size() - ((as.pages - code - heap) << config.page_shift), page -= code + heap;
+        return base + (page << config.page_shift);
+    }
+
+    int64_t alloc_node() {
+        if (!free_nodes.empty()) {
+            int64_t n = free_nodes.back();
+            free_nodes.pop_back();
+            return n;
+        }
+        nodes.emplace_back(512, 0);
+        return nodes.size() - 1;
+    }
+
+    void free_tree(int64_t node, int depth) {
+        for (int64_t entry : nodes[node]) {
+            if (depth > 1 && entry > 0) {
+                free_tree(entry - 1, depth - 1);
+            } else if (depth == 1 && entry > 0) {
+                --stats.resident;
+                if (replacement) {
+                    replacement->removed(entry - 1);
+                    free_frames.push_back(entry - 1);
+                }
+            }
+        }
+        std::fill(nodes[node].begin(), nodes[node].end(), 0);
+        free_nodes.push_back(node);
+    }
+
+    // The leaf page table entry for vpn, creating the tables on the way
+    int64_t& pte(AddressSpace& as, uint64_t vpn, bool count_refs) {
+        int64_t node = as.root;
+        for (int level = config.walk_depth() - 1; level > 0; --level) {
+            if (count_refs) ++stats.walk_refs;
+            int64_t& entry = nodes[node][(vpn >> (9 * level)) & 511];
+            if (!entry) entry = alloc_node() + 1;
+            node = entry - 1;
+        }
+        if (count_refs) ++stats.walk_refs;
+        return nodes[node][vpn & 511];
+    }
+
+    // Page walk: one memory reference per level. A page not in memory is
+    // faulted in: it gets a frame, evicting one if need be. Returns the ms
+    // that takes on the swap device, 0 if none; the page is then mapped at
+    // once, setting loaded, and otherwise the frame is held for it until
+    // page_in_done. Held frames can't be evicted, so when they are all
+    // there is, returns NO_FRAME and takes nothing.
+    int walk(int idx, AddressSpace& as, uint64_t vpn, bool& loaded) {
+        ++stats.walks;
+        int64_t entry = pte(as, vpn, true);
+        if (entry > 0) return 0;
+        int stall = entry == SWAPPED ? config.swap_ms : 0;
+        if (replacement && free_frames.empty() && stats.resident == 0) return NO_FRAME;
+
+        int64_t frame;
+        if (!replacement) {
+            frame = next_frame++;
+        } else if (!free_frames.empty()) {
+            frame = free_frames.back();
+            free_frames.pop_back();
+        } else {
+            frame = evict(as.id << 36 | vpn);
+            if (frames[frame].dirty) {
+                ++stats.writebacks;
+                stall += config.swap_ms;
+            }
+        }
+        if (stall) {
+            as.fault_frame = frame;
+            as.fault_vpn = vpn;
+            as.fault_major = entry == SWAPPED;
+            return stall;
+        }
+        loaded = true;
+        map(idx, as, vpn, frame, entry == SWAPPED);
+        return 0;
+    }
+
+    // Puts vpn of the process in slot idx in frame
+    void map(int idx, AddressSpace& as, uint64_t vpn, int64_t frame, bool major) {
+        if (major) ++stats.major_faults;
+        else ++stats.compulsory;
+        if (replacement) {
+            frames[frame] = Frame{idx, vpn, false};
+            replacement->inserted(frame, as.id << 36 | vpn, stats.accesses);
+        }
+        pte(as, vpn, false) = frame + 1;
+        stats.peak_resident = std::max(stats.peak_resident, ++stats.resident);
+    }
+
+    // Frees a frame for page incoming: the policy's victim goes to swap
+    int evict(uint64_t incoming) {
+        int frame = replacement->victim(incoming, stats.accesses);
+        const Frame& f = frames[frame];
+        AddressSpace& owner = spaces[f.space];
+        pte(owner, f.vpn, false) = SWAPPED;
+        for (Tlb& tlb : tlbs) tlb.invalidate(config.asid ? owner.asid : 0, f.vpn);
+        if (owner.last_vpn == f.vpn) owner.last_vpn = UINT64_MAX;
+        ++stats.evictions;
+        --stats.resident;
+        return frame;
+    }
+
+    // The frame of a resident page, without counting a walk
+    int64_t leaf(const AddressSpace& as, uint64_t vpn) const {
+        int64_t node = as.root;
+        for (int level = config.walk_depth() - 1; level > 0; --level)
+            node = nodes[node][(vpn >> (9 * level)) & 511] - 1;
+        return nodes[node][vpn & 511];
+    }
+};
+
+// Real execution (OSTEP Chapters 6 and 26): each process runs as a
+// user-level thread, a ucontext on its own mmap'd stack with an unmapped
+// guard page below it, so overflowing the stack faults instead of running
+// into the next one. Dispatching a process switches to its thread, which
+// does the slice as real work, us_per_ms of it per simulated ms, and comes
+// back by yielding (coop) or when a one-shot SIGALRM goes off and the
+// handler switches it out (timer), the way a timer interrupt takes the CPU
+// back. Both directions of every switch are timed.
+struct ThreadConfig {
+    std::string mode;           // coop or timer; empty: simulation only
+    int us_per_ms = 20;         // Real work per simulated ms of CPU
+    size_t stack_size = 64 << 10;
+};
+
+// What the threads did over a run
+struct ThreadStats {
+    uint64_t switches_in = 0;   // Scheduler to a process's thread
+    uint64_t switches_out = 0;  // And back
+    double ns_in = 0, ns_out = 0;   // Time those switches took, in total
+    uint64_t timer_preemptions = 0;
+    uint64_t work_us = 0;       // Units of work done, about 1 us each
 };
 
-// Scheduler class: Manages process scheduling (OSTEP Chapters 6–7)
+class UserThreads {
+    struct Thread {
+        char* stack = nullptr;  // Guard page, then stack_size of stack
+        ucontext_t context;     // Points into itself: never copied or moved
+        uint64_t slice_us = 0;  // Work to do before yielding
+    };
+
+public:
+    explicit UserThreads(const ThreadConfig& config) : config(config) {
+        if (!enabled()) return;
+        if (config.mode != "coop" && config.mode != "timer")
+            throw std::runtime_error("unknown thread mode " + config.mode + "; coop or timer");
+        page = size_t(sysconf(_SC_PAGESIZE));
+        iters_per_us = calibrate();
+        if (timer()) {
+            struct sigaction sa;
+            std::memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = on_timer;
+            sigemptyset(&sa.sa_mask);
+            sa.sa_flags = SA_RESTART;
+            sigaction(SIGALRM, &sa, &old_action);
+        }
+    }
+
+    ~UserThreads() {
+        for (auto& t : threads)
+            if (t && t->stack) munmap(t->stack, page + config.stack_size);
+        if (timer()) sigaction(SIGALRM, &old_action, nullptr);
+    }
+
+    UserThreads(const UserThreads&) = delete;
+    UserThreads& operator=(const UserThreads&) = delete;
+
+    bool enabled() const { return !config.mode.empty(); }
+    const ThreadConfig& thread_config() const { return config; }
+    const ThreadStats& thread_stats() const { return stats; }
+
+    // The process in slot idx runs for the first time: a new thread for it,
+    // on the slot's stack
+    void start(int idx) {
+        if (!enabled()) return;
+        if (size_t(idx) >= threads.size()) threads.resize(idx + 1);
+        if (!threads[idx]) threads[idx] = std::make_unique<Thread>();
+        Thread& t = *threads[idx];
+        if (!t.stack) {
+            void* p = mmap(nullptr, page + config.stack_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::runtime_error(std::string("thread stack: ") + std::strerror(errno));
+            t.stack = static_cast<char*>(p);
+            if (mprotect(t.stack, page, PROT_NONE) != 0)
+                throw std::runtime_error(std::string("guard page: ") + std::strerror(errno));
+        }
+        getcontext(&t.context);
+        t.context.uc_stack.ss_sp = t.stack + page;
+        t.context.uc_stack.ss_size = config.stack_size;
+        t.context.uc_link = nullptr;    // Never returns
+        makecontext(&t.context, thread_main, 0);
+    }
+
+    // Switch to the thread of the process in slot idx for ms of simulated
+    // CPU, and back when it yields or the timer takes it off
+    void run(int idx, int ms) {
+        if (!enabled() || ms <= 0) return;
+        active = this;
+        current = threads[idx].get();
+        current->slice_us = uint64_t(ms) * config.us_per_ms;
+        if (timer()) {
+            // An alarm from the last slice may have been left pending
+            pending = 0;
+            itimerval it;
+            std::memset(&it, 0, sizeof(it));
+            it.it_value.tv_sec = current->slice_us / 1000000;
+            it.it_value.tv_usec = current->slice_us % 1000000;
+            setitimer(ITIMER_REAL, &it, nullptr);
+        }
+        switch_start = now_ns();
+        swapcontext(&scheduler, &current->context);
+        stats.ns_out += now_ns() - switch_start;
+        ++stats.switches_out;
+        current = nullptr;
+    }
+
+private:
+    bool timer() const { return config.mode == "timer"; }
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t spin(uint64_t n, uint64_t x) {
+        for (uint64_t i = 0; i < n; ++i) x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        return x;
+    }
+
+    // Iterations of spin() in about a microsecond, from the fastest of a few runs
+    static uint64_t calibrate() {
+        const uint64_t n = 1 << 18;
+        int64_t best = INT64_MAX;
+        for (int i = 0; i < 5; ++i) {
+            int64_t start = now_ns();
+            sink = spin(n, sink);
+            best = std::min(best, now_ns() - start);
+        }
+        return std::max<uint64_t>(1, n * 1000 / std::max<int64_t>(1, best));
+    }
+
+    void work() {
+        sink = spin(iters_per_us, sink);
+        ++stats.work_us;
+        // The count has to be in memory when the timer switches the thread out
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    // Thread side of a switch in, and out
+    void arrive() {
+        stats.ns_in += now_ns() - switch_start;
+        ++stats.switches_in;
+        in_thread = 1;
+    }
+
+    void leave() {
+        in_thread = 0;
+        switch_start = now_ns();
+        swapcontext(&current->context, &scheduler);
+    }
+
+    // Whether the alarm went off while the thread was not yet in
+    bool take_pending() {
+        if (!pending) return false;
+        pending = 0;
+        ++stats.timer_preemptions;
+        return true;
+    }
+
+    // Back to the scheduler, carrying on from here when next dispatched
+    void yield() {
+        do {
+            leave();
+            arrive();
+        } while (take_pending());
+    }
+
+    static void thread_main() {
+        UserThreads& self = *active;
+        self.arrive();
+        if (self.take_pending()) self.yield();
+        for (;;) {
+            if (self.timer())
+                for (;;) self.work();   // Until the timer takes the CPU back
+            for (uint64_t us = 0; us < self.current->slice_us; ++us) self.work();
+            self.yield();
+        }
+    }
+
+    // Timer interrupt: off the CPU, unless the switch in is still under
+    // way, when the thread leaves as soon as it arrives
+    static void on_timer(int) {
+        if (!in_thread) {
+            pending = 1;
+            return;
+        }
+        ++active->stats.timer_preemptions;
+        active->yield();
+    }
+
+    ThreadConfig config;
+    ThreadStats stats;
+    std::vector<std::unique_ptr<Thread>> threads;  // By process slot
+    ucontext_t scheduler;       // Where threads switch back to
+    Thread* current = nullptr;  // Thread on the CPU, during run()
+    int64_t switch_start = 0;
+    size_t page = 4096;
+    uint64_t iters_per_us = 1;
+    struct sigaction old_action;
+
+    static inline UserThreads* active = nullptr;    // For thread_main and the handler
+    static inline volatile sig_atomic_t in_thread = 0, pending = 0;
+    static inline volatile uint64_t sink = 1;       // Keeps the work from being optimized out
+};
+
+// ns per switch between two ucontexts on one stack each, best of a few
+// runs of rounds round trips. swapcontext also sets the signal mask, a
+// system call, most of what it costs.
+double ucontext_switch_ns(int rounds) {
+    static ucontext_t main_context, other;
+    std::vector<char> stack(64 << 10);
+    getcontext(&other);
+    other.uc_stack.ss_sp = stack.data();
+    other.uc_stack.ss_size = stack.size();
+    other.uc_link = nullptr;
+    makecontext(&other, [] { for (;;) swapcontext(&other, &main_context); }, 0);
+    double best = INFINITY;
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) swapcontext(&main_context, &other);
+        std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count() / (2.0 * rounds));
+    }
+    return best;
+}
+
+// ns per switch between two kernel threads on one CPU handing a futex back
+// and forth, so each hand-off blocks one and wakes the other; best of a few
+// runs of rounds round trips, after a few to get both threads going
+double kernel_switch_ns(int rounds) {
+    const int warmup = 100;
+    const int cpu = std::max(0, sched_getcpu());
+    double best = INFINITY;
+    for (int run = 0; run < 3; ++run) {
+        std::atomic<int> turn{0};
+        auto futex = [&](int op, int val) {
+            syscall(SYS_futex, reinterpret_cast<int*>(&turn), op, val, nullptr, nullptr, 0);
+        };
+        auto wait_for = [&](int me) {
+            while (turn.load() != me) futex(FUTEX_WAIT_PRIVATE, 1 - me);
+        };
+        auto pass_to = [&](int other) {
+            turn.store(other);
+            futex(FUTEX_WAKE_PRIVATE, 1);
+        };
+        std::chrono::steady_clock::time_point start;
+        std::thread ping([&] {
+            bench::pin_thread(pthread_self(), cpu);
+            for (int r = 0; r < warmup + rounds; ++r) {
+                if (r == warmup) start = std::chrono::steady_clock::now();
+                pass_to(1);
+                wait_for(0);
+            }
+        });
+        std::thread pong([&] {
+            bench::pin_thread(pthread_self(), cpu);
+            for (int r = 0; r < warmup + rounds; ++r) {
+                wait_for(1);
+                pass_to(0);
+            }
+        });
+        pong.join();
+        ping.join();
+        std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count() / (2.0 * rounds));
+    }
+    return best;
+}
+
+// FIFO of ready processes, linked through the processes themselves
+// (rq_prev/rq_next), so push, pop and unlinking from the middle are all
+// O(1) and nothing is copied or shifted however long the queue gets.
+class RunQueue {
+    std::vector<Process>* procs = nullptr;
+    int head = -1, tail = -1;
+    size_t count = 0;
+
+public:
+    RunQueue() = default;
+    explicit RunQueue(std::vector<Process>& table) : procs(&table) {}
+    void attach(std::vector<Process>& table) { procs = &table; }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    int front() const { return head; }
+    int back() const { return tail; }
+    int next(int idx) const { return (*procs)[idx].rq_next; }
+
+    void push_back(int idx) {
+        Process& p = (*procs)[idx];
+        p.rq_prev = tail;
+        p.rq_next = -1;
+        if (tail >= 0) (*procs)[tail].rq_next = idx;
+        else head = idx;
+        tail = idx;
+        ++count;
+    }
+
+    void remove(int idx) {
+        Process& p = (*procs)[idx];
+        if (p.rq_prev >= 0) (*procs)[p.rq_prev].rq_next = p.rq_next;
+        else head = p.rq_next;
+        if (p.rq_next >= 0) (*procs)[p.rq_next].rq_prev = p.rq_prev;
+        else tail = p.rq_prev;
+        p.rq_prev = p.rq_next = -1;
+        --count;
+    }
+
+    int pop_front() {
+        int idx = head;
+        remove(idx);
+        return idx;
+    }
+};
+
+// Things that happen at an instant of simulated time
+enum class EventType { ARRIVAL, SLICE_END, IO_DONE, REBALANCE };
+
+struct Event {
+    Time time;
+    uint64_t seq;       // Events at the same time run in the order scheduled
+    EventType type;
+    int proc;           // Index into Scheduler::processes
+    uint32_t gen;       // SLICE_END: stale once the slice was cut short
+    int cpu;            // SLICE_END: CPU whose slice it is
+
+    bool operator>(const Event& other) const {
+        return time != other.time ? time > other.time : seq > other.seq;
+    }
+};
+
+// Min-heap of pending events: the discrete-event engine's clock
+class EventQueue {
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> heap;
+    uint64_t next_seq = 0;
+
+public:
+    void schedule(Time time, EventType type, int proc, uint32_t gen = 0, int cpu = 0) {
+        heap.push(Event{time, next_seq++, type, proc, gen, cpu});
+    }
+    bool empty() const { return heap.empty(); }
+    Event pop() {
+        Event e = heap.top();
+        heap.pop();
+        return e;
+    }
+};
+
+// Scheduling policy: which ready process runs next and for how long
+// (OSTEP Chapters 7–9). The Scheduler owns the mechanism (events, dispatch,
+// preemption, accounting); a policy only orders the ready processes, which
+// it sees as indices into the scheduler's process table. Each CPU has its
+// own instance, so per-process policy state (MLFQ level, pass, vruntime)
+// is per CPU: a migrated process starts on its new CPU as a newcomer would.
+class SchedulingPolicy {
+public:
+    virtual ~SchedulingPolicy() = default;
+    virtual const char* name() const = 0;
+    virtual void attach(std::vector<Process>& table) { procs = &table; }
+
+    virtual void enqueue(int idx, Time now) = 0;    // idx became ready
+    virtual int pick_next(Time now) = 0;             // Remove and return the next, -1 if none
+    virtual int steal() = 0;                         // Remove the least urgent, for another CPU
+    virtual bool empty() const = 0;
+    virtual size_t size() const = 0;
+
+    // Longest idx may run before the policy wants to choose again
+    virtual int time_slice(int idx) const = 0;
+    // idx ran for ran ms, a whole slice or cut short
+    virtual void charge(int, int, Time) {}
+    // Whether newly ready idx should take the CPU from running, which has
+    // been on it for ran ms of its current slice
+    virtual bool preempts(int, int, int) const { return false; }
+    // idx has exited; its slot will be reused for a new process
+    virtual void release(int) {}
+
+protected:
+    Process& proc(int idx) const { return (*procs)[idx]; }
+    std::vector<Process>* procs = nullptr;
+};
+
+// First in, first out; each process runs to completion
+class FifoPolicy : public SchedulingPolicy {
+protected:
+    RunQueue queue;
+
+public:
+    const char* name() const override { return "fifo"; }
+    void attach(std::vector<Process>& table) override {
+        SchedulingPolicy::attach(table);
+        queue.attach(table);
+    }
+    void enqueue(int idx, Time) override { queue.push_back(idx); }
+    int pick_next(Time) override { return queue.empty() ? -1 : queue.pop_front(); }
+    int steal() override {
+        int idx = queue.back();
+        if (idx >= 0) queue.remove(idx);
+        return idx;
+    }
+    bool empty() const override { return queue.empty(); }
+    size_t size() const override { return queue.size(); }
+    int time_slice(int idx) const override { return proc(idx).remaining_time; }
+};
+
+// FIFO with a time quantum
+class RoundRobinPolicy : public FifoPolicy {
+    int quantum;
+
+public:
+    explicit RoundRobinPolicy(int quantum) : quantum(quantum) {}
+    const char* name() const override { return "rr"; }
+    int time_slice(int) const override { return quantum; }
+};
+
+// Shortest job first: the ready process with the least CPU time left runs
+// to completion. Preemptive (STCF), a new arrival with less left than the
+// running process takes the CPU from it.
+class ShortestFirstPolicy : public SchedulingPolicy {
+    std::set<std::pair<int, int>> ready;    // (remaining_time, idx)
+    bool preemptive;
+
+public:
+    explicit ShortestFirstPolicy(bool preemptive) : preemptive(preemptive) {}
+    const char* name() const override { return preemptive ? "stcf" : "sjf"; }
+    void enqueue(int idx, Time) override { ready.emplace(proc(idx).remaining_time, idx); }
+    int pick_next(Time) override {
+        if (ready.empty()) return -1;
+        int idx = ready.begin()->second;
+        ready.erase(ready.begin());
+        return idx;
+    }
+    int steal() override {
+        if (ready.empty()) return -1;
+        int idx = ready.rbegin()->second;
+        ready.erase(std::prev(ready.end()));
+        return idx;
+    }
+    bool empty() const override { return ready.empty(); }
+    size_t size() const override { return ready.size(); }
+    int time_slice(int idx) const override { return proc(idx).remaining_time; }
+    bool preempts(int idx, int running, int ran) const override {
+        return preemptive && proc(idx).remaining_time < proc(running).remaining_time - ran;
+    }
+};
+
+// Multi-level feedback queue (OSTEP Chapter 8): round robin within a level,
+// higher levels first, and a higher level preempts a lower one. Slices
+// double at each level down. A process that has used a slice's worth of CPU
+// at its level (in any number of pieces, so yielding early doesn't game it)
+// moves down one; every boost_ms everyone goes back to the top so long jobs
+// don't starve.
+class MlfqPolicy : public SchedulingPolicy {
+    std::vector<RunQueue> levels;
+    std::vector<int> level;     // Per process
+    std::vector<int> used;      // CPU used at the current level
+    int quantum;
+    Time boost_ms, last_boost = 0;
+    size_t count = 0;
+
+    void grow() {
+        if (level.size() < procs->size()) {
+            level.resize(procs->size(), 0);
+            used.resize(procs->size(), 0);
+        }
+    }
+
+    // Every process goes back to the top with a fresh allotment: the queued
+    // ones, and also those running or blocked, which would otherwise keep
+    // their old level when they next become ready
+    void boost() {
+        std::fill(level.begin(), level.end(), 0);
+        std::fill(used.begin(), used.end(), 0);
+        for (size_t l = 1; l < levels.size(); ++l)
+            while (!levels[l].empty())
+                levels[0].push_back(levels[l].pop_front());
+    }
+
+public:
+    MlfqPolicy(int quantum, int nlevels = 3, Time boost_ms = 1000)
+        : levels(nlevels), quantum(quantum), boost_ms(boost_ms) {}
+    const char* name() const override { return "mlfq"; }
+    void attach(std::vector<Process>& table) override {
+        SchedulingPolicy::attach(table);
+        for (auto& q : levels) q.attach(table);
+    }
+    void enqueue(int idx, Time) override {
+        grow();
+        levels[level[idx]].push_back(idx);
+        ++count;
+    }
+    int pick_next(Time now) override {
+        if (now - last_boost >= boost_ms) {
+            boost();
+            last_boost = now;
+        }
+        for (auto& q : levels)
+            if (!q.empty()) {
+                --count;
+                return q.pop_front();
+            }
+        return -1;
+    }
+    int steal() override {
+        for (auto q = levels.rbegin(); q != levels.rend(); ++q)
+            if (!q->empty()) {
+                int idx = q->back();
+                q->remove(idx);
+                --count;
+                return idx;
+            }
+        return -1;
+    }
+    bool empty() const override { return count == 0; }
+    size_t size() const override { return count; }
+    int time_slice(int idx) const override { return quantum << level[idx]; }
+    void charge(int idx, int ran, Time) override {
+        used[idx] += ran;
+        if (used[idx] >= time_slice(idx) && level[idx] + 1 < (int)levels.size()) {
+            ++level[idx];
+            used[idx] = 0;
+        }
+    }
+    bool preempts(int idx, int running, int) const override {
+        return level[idx] < level[running];
+    }
+    void release(int idx) override {
+        if (size_t(idx) < level.size()) level[idx] = used[idx] = 0;
+    }
+};
+
+// Lottery (OSTEP Chapter 9): each slice goes to a random ready process with
+// probability proportional to its tickets (its weight). The book walks the
+// ready list to find the winner, O(n); here the tickets are summed in a
+// Fenwick tree over process slots, so the draw, enqueue and removal are
+// all O(log n). The list is kept for stealing.
+class LotteryPolicy : public SchedulingPolicy {
+    RunQueue queue;
+    std::vector<int64_t> tickets;   // Fenwick tree of ready tickets, by slot + 1
+    int64_t total = 0;
+    int quantum;
+    std::mt19937_64 rng;
+
+    // Adds w to slot idx's tickets
+    void add(int idx, int64_t w) {
+        for (size_t i = idx + 1; i < tickets.size(); i += i & -i) tickets[i] += w;
+        total += w;
+    }
+
+    // Room for every slot; rebuilt from the queue, doubling, when the
+    // process table outgrows it
+    void grow() {
+        if (tickets.size() > procs->size()) return;
+        tickets.assign(std::max<size_t>(64, 2 * procs->size()) + 1, 0);
+        total = 0;
+        for (int idx = queue.front(); idx >= 0; idx = queue.next(idx)) add(idx, proc(idx).weight);
+    }
+
+    // The slot whose tickets hold ticket number winner, 0..total-1
+    int find(int64_t winner) const {
+        size_t pos = 0;
+        size_t step = 1;
+        while (step * 2 < tickets.size()) step *= 2;
+        for (; step; step /= 2)
+            if (pos + step < tickets.size() && tickets[pos + step] <= winner) {
+                pos += step;
+                winner -= tickets[pos];
+            }
+        return int(pos);
+    }
+
+    void take(int idx) {
+        queue.remove(idx);
+        add(idx, -proc(idx).weight);
+    }
+
+public:
+    LotteryPolicy(int quantum, uint64_t seed) : quantum(quantum), rng(seed) {}
+    const char* name() const override { return "lottery"; }
+    void attach(std::vector<Process>& table) override {
+        SchedulingPolicy::attach(table);
+        queue.attach(table);
+    }
+    void enqueue(int idx, Time) override {
+        grow();
+        queue.push_back(idx);
+        add(idx, proc(idx).weight);
+    }
+    int pick_next(Time) override {
+        if (queue.empty()) return -1;
+        int64_t winner = std::uniform_int_distribution<int64_t>(0, total - 1)(rng);
+        int idx = find(winner);
+        take(idx);
+        return idx;
+    }
+    int steal() override {
+        int idx = queue.back();
+        if (idx < 0) return -1;
+        take(idx);
+        return idx;
+    }
+    bool empty() const override { return queue.empty(); }
+    size_t size() const override { return queue.size(); }
+    int time_slice(int) const override { return quantum; }
+};
+
+// Stride (OSTEP Chapter 9): the deterministic lottery. Each process's pass
+// advances by BIG / weight per ms it runs, and the lowest pass runs next. A
+// newcomer starts at the lowest pass in the queue rather than at 0, so it
+// can't monopolise the CPU catching up.
+class StridePolicy : public SchedulingPolicy {
+    static constexpr int64_t BIG = 1 << 20;
+    std::set<std::pair<int64_t, int>> ready;    // (pass, idx)
+    std::vector<int64_t> pass;                  // Per process, -1 before it first ran
+    int64_t global_pass = 0;                    // Pass of the last process picked
+    int quantum;
+
+public:
+    explicit StridePolicy(int quantum) : quantum(quantum) {}
+    const char* name() const override { return "stride"; }
+    void enqueue(int idx, Time) override {
+        if (pass.size() < procs->size()) pass.resize(procs->size(), -1);
+        pass[idx] = std::max(pass[idx], global_pass);
+        ready.emplace(pass[idx], idx);
+    }
+    int pick_next(Time) override {
+        if (ready.empty()) return -1;
+        auto [p, idx] = *ready.begin();
+        ready.erase(ready.begin());
+        global_pass = p;
+        return idx;
+    }
+    int steal() override {
+        if (ready.empty()) return -1;
+        int idx = ready.rbegin()->second;
+        ready.erase(std::prev(ready.end()));
+        return idx;
+    }
+    bool empty() const override { return ready.empty(); }
+    size_t size() const override { return ready.size(); }
+    int time_slice(int) const override { return quantum; }
+    void charge(int idx, int ran, Time) override { pass[idx] += BIG / proc(idx).weight * ran; }
+    void release(int idx) override {
+        if (size_t(idx) < pass.size()) pass[idx] = -1;
+    }
+};
+
+// CFS-like: every process accrues virtual runtime at 1024 / weight of real
+// time, and the one with the least runs next. The ready set is a std::set,
+// a red-black tree in libstdc++ as in the kernel. The slice is the target
+// latency split over the ready processes, but no less than min_granularity.
+// A waking process gets at least min_vruntime minus half the latency, so
+// sleeping builds up no more than a bounded credit; a new one starts at
+// min_vruntime.
+class CfsPolicy : public SchedulingPolicy {
+    std::set<std::pair<int64_t, int>> tree;     // (vruntime, idx)
+    std::vector<int64_t> vruntime;              // Per process, in µs; -1 before it first ran
+    int64_t min_vruntime = 0;
+    int latency, min_granularity;               // ms
+
+    int64_t weighted(int idx, int ms) const { return int64_t(ms) * 1000 * 1024 / proc(idx).weight; }
+
+public:
+    CfsPolicy(int latency = 24, int min_granularity = 3)
+        : latency(latency), min_granularity(min_granularity) {}
+    const char* name() const override { return "cfs"; }
+    void enqueue(int idx, Time) override {
+        if (vruntime.size() < procs->size()) vruntime.resize(procs->size(), -1);
+        int64_t& v = vruntime[idx];
+        v = v < 0 ? min_vruntime : std::max(v, min_vruntime - int64_t(latency) * 1000 / 2);
+        tree.emplace(v, idx);
+    }
+    int pick_next(Time) override {
+        if (tree.empty()) return -1;
+        auto [v, idx] = *tree.begin();
+        tree.erase(tree.begin());
+        min_vruntime = std::max(min_vruntime, v);
+        return idx;
+    }
+    int steal() override {
+        if (tree.empty()) return -1;
+        int idx = tree.rbegin()->second;
+        tree.erase(std::prev(tree.end()));
+        return idx;
+    }
+    bool empty() const override { return tree.empty(); }
+    size_t size() const override { return tree.size(); }
+    int time_slice(int) const override {
+        return std::max<int>(min_granularity, latency / int(tree.size() + 1));
+    }
+    void charge(int idx, int ran, Time) override { vruntime[idx] += weighted(idx, ran); }
+    bool preempts(int idx, int running, int ran) const override {
+        // Wake-up preemption, with a granularity so it doesn't thrash
+        return vruntime[idx] + weighted(idx, min_granularity) < vruntime[running] + weighted(running, ran);
+    }
+    void release(int idx) override {
+        if (size_t(idx) < vruntime.size()) vruntime[idx] = -1;
+    }
+};
+
+const char* const policy_names[] = {"fifo", "sjf", "stcf", "rr", "mlfq", "lottery", "stride", "cfs"};
+
+std::unique_ptr<SchedulingPolicy> make_policy(const std::string& name, int quantum, uint64_t seed = 1) {
+    if (name == "fifo") return std::make_unique<FifoPolicy>();
+    if (name == "sjf") return std::make_unique<ShortestFirstPolicy>(false);
+    if (name == "stcf") return std::make_unique<ShortestFirstPolicy>(true);
+    if (name == "rr") return std::make_unique<RoundRobinPolicy>(quantum);
+    if (name == "mlfq") return std::make_unique<MlfqPolicy>(quantum);
+    if (name == "lottery") return std::make_unique<LotteryPolicy>(quantum, seed);
+    if (name == "stride") return std::make_unique<StridePolicy>(quantum);
+    if (name == "cfs") return std::make_unique<CfsPolicy>();
+    return nullptr;
+}
+
+// What a run achieved, over all processes (means in ms)
+struct Metrics {
+    double turnaround = 0;          // Completion - arrival
+    double response = 0;            // First run - arrival
+    double waiting = 0;             // Time ready but not running
+    double p99_response = 0;
+    double max_response = 0;
+    double fairness = 0;            // Jain's index of slowdown (turnaround / burst): 1 = even
+    double weighted_fairness = 0;   // The same of slowdown * weight / 1024: 1 = shares kept
+    int interactive = 0;            // Count, and their means, when the workload has any
+    double interactive_response = 0;
+    double batch_turnaround = 0;
+    std::vector<double> utilization;    // Per CPU, busy time / elapsed
+    uint64_t migrations = 0;        // Dispatches on a CPU other than the last one
+    std::vector<double> device_utilization;
+    uint64_t io_requests = 0;
+    double io_queue_delay = 0;      // Mean wait for the device before an I/O starts
+    size_t completed = 0;
+    double throughput = 0;          // Processes finished per simulated second
+    PagingStats paging;
+    double swap_utilization = 0;
+    double swap_queue_delay = 0;    // Mean wait for the swap device before a page-in starts
+};
+
+// Load balancing between the per-CPU run queues, any combination of:
+//   push      a process becoming ready goes to the least loaded CPU when
+//             that is less loaded than the one it would join
+//   pull      a CPU about to go idle steals from the busiest queue
+//   periodic  every balance interval, move processes from the busiest
+//             queue to the least loaded until they are within one
+enum Balance { BALANCE_PUSH = 1, BALANCE_PULL = 2, BALANCE_PERIODIC = 4 };
+
+// Parses "push,pull,periodic" or "none"; -1 if a name is unknown
+int parse_balance(const std::string& list) {
+    int flags = 0;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = std::min(list.find(',', start), list.size());
+        std::string name = list.substr(start, end - start);
+        if (name == "push") flags |= BALANCE_PUSH;
+        else if (name == "pull" || name == "steal") flags |= BALANCE_PULL;
+        else if (name == "periodic") flags |= BALANCE_PERIODIC;
+        else if (name != "none") return -1;
+        start = end + 1;
+    }
+    return flags;
+}
+
+
+// Machine the workload runs on
+struct MachineConfig {
+    int cpus = 1;
+    int balance = BALANCE_PULL | BALANCE_PERIODIC;
+    int migration_cost = 1;     // ms
+    Time balance_interval = 4;  // ms
+    int devices = 1;            // I/O devices; process p uses device p % devices
+    PagingConfig paging;
+    ThreadConfig threads;
+};
+
+// Where processes come from, in order of arrival. The scheduler reads one
+// at a time, as the one before arrives, so a workload is never all in memory.
+class WorkloadSource {
+public:
+    virtual ~WorkloadSource() = default;
+    virtual std::optional<Process> next() = 0;   // nullopt at the end
+};
+
+// Random workload: nprocs processes with bursts of 10–100 ms (1–10 ms for
+// the interactive fraction), cpu_bursts of them each with 5–50 ms of I/O in
+// between, and exponential inter-arrival times with the given mean (0: all
+// arrive at once). Batch processes run at nice 0, interactive ones at
+// interactive_nice.
+class GeneratedWorkload : public WorkloadSource {
+    int nprocs, cpu_bursts;
+    double interactive_frac, mean_interarrival;
+    int interactive_nice;
+    int next_pid = 0;
+    Time arrival = 0;
+
+public:
+    GeneratedWorkload(int nprocs, double interactive_frac, double mean_interarrival,
+                      int cpu_bursts, unsigned seed, int interactive_nice = 0)
+        : nprocs(nprocs), cpu_bursts(cpu_bursts), interactive_frac(interactive_frac),
+          mean_interarrival(mean_interarrival), interactive_nice(interactive_nice) {
+        // Seed random number generator
+        srand(seed);
+    }
+
+    std::optional<Process> next() override {
+        if (next_pid == nprocs) return std::nullopt;
+        bool interactive = interactive_frac > 0 && rand() < interactive_frac * RAND_MAX;
+        auto burst = [&] { return interactive ? 1 + rand() % 10 : 10 + (rand() % 91); };
+        Process p(next_pid++, burst(), arrival, nice_weight(interactive ? interactive_nice : 0), interactive);
+        for (int i = 1; i < cpu_bursts; ++i) {
+            int io = 5 + rand() % 46;
+            p.add_io(io, burst());
+        }
+        if (mean_interarrival > 0)
+            arrival += Time(-mean_interarrival * std::log(1.0 - rand() / (RAND_MAX + 1.0)));
+        return p;
+    }
+};
+
+// Workload trace, read as the simulation goes, in one of two formats:
+//   CSV     one process per line: pid,arrival_ms[,nice],cpu_ms[,io_ms,cpu_ms]...
+//           The bursts are always odd in number, so an even count means
+//           the first field after arrival is the nice value (default 0).
+//           Blank lines, # comments and a header line are skipped.
+//   binary  "PSIMTRC2", then per process int64 arrival_ms, int32 pid,
+//           int32 nice, uint32 n, and n int32 bursts (CPU, I/O, ..., CPU),
+//           in host byte order; write_trace makes one. "PSIMTRC1" files,
+//           without the nice, are read too.
+// Processes must be in order of arrival. One whose mean CPU burst is at
+// most 10 ms counts as interactive.
+class TraceReader : public WorkloadSource {
+public:
+    static constexpr char magic[8] = {'P', 'S', 'I', 'M', 'T', 'R', 'C', '2'};
+    static constexpr char magic_v1[8] = {'P', 'S', 'I', 'M', 'T', 'R', 'C', '1'};
+
+    explicit TraceReader(const std::string& path) : path(path) {
+        file = std::fopen(path.c_str(), "rb");
+        if (!file) throw std::runtime_error(path + ": " + std::strerror(errno));
+        char head[sizeof(magic)];
+        bool whole = std::fread(head, 1, sizeof(head), file) == sizeof(head);
+        binary = whole && std::memcmp(head, magic, sizeof(magic)) == 0;
+        with_nice = binary;
+        if (whole && std::memcmp(head, magic_v1, sizeof(magic_v1)) == 0) binary = true;
+        if (!binary) std::rewind(file);
+    }
+
+    ~TraceReader() {
+        std::fclose(file);
+        std::free(line);
+    }
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    std::optional<Process> next() override {
+        return binary ? next_binary() : next_csv();
+    }
+
+private:
+    std::string path;
+    FILE* file;
+    bool binary;
+    bool with_nice;             // Binary records have a nice field
+    char* line = nullptr;       // getline's buffer
+    size_t line_cap = 0;
+    size_t line_no = 0;
+    std::vector<int> bursts;
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error(path + (binary ? "" : ":" + std::to_string(line_no)) + ": " + what);
+    }
+
+    std::optional<Process> next_csv() {
+        while (getline(&line, &line_cap, file) > 0) {
+            ++line_no;
+            const char* p = line;
+            while (*p == ' ' || *p == '\t') ++p;
+            if (!std::isdigit(static_cast<unsigned char>(*p))) continue;   // Blank, comment or header
+
+            char* end;
+            long long fields[2];
+            for (long long& f : fields) {
+                f = std::strtoll(p, &end, 10);
+                if (end == p || *end != ',') fail("expected pid,arrival[,nice],cpu[,io,cpu]...");
+                p = end + 1;
+            }
+            bursts.clear();
+            for (;;) {
+                long v = std::strtol(p, &end, 10);
+                if (end == p) fail("expected a burst length");
+                bursts.push_back(int(v));
+                while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') ++end;
+                if (*end != ',') break;
+                p = end + 1;
+            }
+            if (*end) fail("unexpected text after the bursts");
+            int nice = 0;
+            if (bursts.size() % 2 == 0) {
+                nice = bursts[0];
+                bursts.erase(bursts.begin());
+            }
+            return make_process(int(fields[0]), fields[1], nice);
+        }
+        if (std::ferror(file)) fail(std::strerror(errno));
+        return std::nullopt;
+    }
+
+    std::optional<Process> next_binary() {
+        int64_t arrival;
+        int32_t pid, nice = 0;
+        uint32_t n;
+        if (std::fread(&arrival, sizeof(arrival), 1, file) != 1) {
+            if (std::ferror(file)) fail(std::strerror(errno));
+            return std::nullopt;
+        }
+        if (std::fread(&pid, sizeof(pid), 1, file) != 1 ||
+            (with_nice && std::fread(&nice, sizeof(nice), 1, file) != 1) ||
+            std::fread(&n, sizeof(n), 1, file) != 1)
+            fail("truncated record");
+        bursts.resize(n);
+        if (std::fread(bursts.data(), sizeof(int32_t), n, file) != n)
+            fail("truncated record");
+        return make_process(pid, arrival, nice);
+    }
+
+    Process make_process(int pid, Time arrival, int nice) {
+        if (bursts.size() % 2 == 0) fail("bursts must alternate CPU, I/O, ..., CPU");
+        if (nice < -20 || nice > 19) fail("nice must be -20..19");
+        int cpu = 0;
+        for (size_t i = 0; i < bursts.size(); ++i) {
+            if (bursts[i] < (i % 2 ? 0 : 1)) fail("CPU bursts must be positive, I/O not negative");
+            if (i % 2 == 0) cpu += bursts[i];
+        }
+        bool interactive = cpu <= 10 * int(bursts.size() / 2 + 1);
+        Process p(pid, bursts[0], arrival, nice_weight(nice), interactive);
+        for (size_t i = 1; i + 1 < bursts.size(); i += 2)
+            p.add_io(bursts[i], bursts[i + 1]);
+        return p;
+    }
+};
+
+// Writes a workload as a trace TraceReader reads back: binary when path
+// ends in .bin, CSV otherwise
+void write_trace(WorkloadSource& source, const std::string& path) {
+    bool binary = path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+    FILE* out = std::fopen(path.c_str(), binary ? "wb" : "w");
+    if (!out) throw std::runtime_error(path + ": " + std::strerror(errno));
+    if (binary) std::fwrite(TraceReader::magic, 1, sizeof(TraceReader::magic), out);
+    else std::fprintf(out, "# pid,arrival_ms[,nice],cpu_ms[,io_ms,cpu_ms]...\n");
+    while (auto p = source.next()) {
+        int32_t nice = weight_nice(p->weight);
+        if (binary) {
+            int64_t arrival = p->arrival_time;
+            int32_t pid = p->pid;
+            uint32_t n = 1 + p->bursts.size();
+            std::fwrite(&arrival, sizeof(arrival), 1, out);
+            std::fwrite(&pid, sizeof(pid), 1, out);
+            std::fwrite(&nice, sizeof(nice), 1, out);
+            std::fwrite(&n, sizeof(n), 1, out);
+            std::fwrite(&p->remaining_time, sizeof(int32_t), 1, out);
+            std::fwrite(p->bursts.data(), sizeof(int32_t), p->bursts.size(), out);
+        } else {
+            std::fprintf(out, "%d,%lld", p->pid, (long long)p->arrival_time);
+            if (nice) std::fprintf(out, ",%d", nice);
+            std::fprintf(out, ",%d", p->remaining_time);
+            for (int b : p->bursts) std::fprintf(out, ",%d", b);
+            std::fputc('\n', out);
+        }
+    }
+    if (std::fclose(out) != 0) throw std::runtime_error(path + ": " + std::strerror(errno));
+}
+
+// Scheduler class: Manages process scheduling (OSTEP Chapters 6–7), on one
+// or more CPUs (Chapter 10), each with its own run queue and policy, with
+// processes blocking on I/O devices between CPU bursts (Chapter 36)
 class Scheduler {
-    std::vector<Process> ready_queue; // Ready processes
-    int time_quantum;                 // Round-robin quantum (ms)
-    int current_time;                 // Simulation time
+public:
+    using PolicyFactory = std::function<std::unique_ptr<SchedulingPolicy>(int cpu)>;
+
+private:
+    // One simulated CPU
+    struct Cpu {
+        std::unique_ptr<SchedulingPolicy> policy;  // Orders this CPU's ready processes
+        int running = -1;             // Process on the CPU, -1 when idle
+        Time slice_start = 0;         // When running was dispatched
+        int warmup = 0;               // Of this slice, ms spent refilling a cold cache
+        int stall = 0;                // Swap wait of a page fault the slice ends in, 0 if none
+        uint32_t slice_gen = 0;       // Bumped to cancel the pending SLICE_END
+        Time busy = 0;                // Total time running something
+        uint64_t dispatches = 0;
+        uint64_t migrations = 0;      // Dispatches of a process that last ran elsewhere
+
+        size_t load() const { return policy->size() + (running >= 0); }
+    };
+
+    // One simulated I/O device, serving requests one at a time in order
+    struct Device {
+        RunQueue queue;               // Blocked processes waiting for it
+        int serving = -1;             // Process whose I/O is in progress, -1 when idle
+        Time busy = 0;
+        uint64_t requests = 0;
+        Time queue_delay = 0;         // Total time requests waited to start
+    };
+
+    // Finished processes, summed as they finish so their slots can be reused
+    struct Totals {
+        size_t n = 0;
+        double turnaround = 0, response = 0, waiting = 0;
+        double slowdown = 0, slowdown2 = 0;
+        double wslowdown = 0, wslowdown2 = 0;
+        int interactive = 0;
+        double interactive_response = 0, batch_turnaround = 0;
+        std::vector<float> responses;
+    };
+
+    std::vector<Process> processes;   // Live processes; the queues hold indices into it
+    std::vector<int> free_slots;      // Slots of processes that have exited
+    std::vector<Cpu> cpus;
+    std::vector<Device> devices;
+    Device swap;                      // Where page faults wait
+    RunQueue frame_waiters;           // Faulted with every frame held for a page-in
+    EventQueue events;                // Pending arrivals, slice ends and I/O completions
+    Time current_time;                // Simulation time
+    MachineConfig machine;
+    uint64_t preemptions;             // Slices cut short by an arrival
+    std::mt19937 placement;           // Picks the CPU an arrival starts on
+    WorkloadSource* source;           // Where the next arrival comes from, during run()
+    Time last_arrival;
+    Totals done;
+    bool verbose;                     // Print each completion
     MMU mmu;                          // MMU for address translation
-    std::mutex queue_mutex;           // Thread safety
+    UserThreads threads;              // Processes' real threads, when they run for real
+    std::mutex queue_mutex;           // Thread safety of the public interface
 
 public:
-    Scheduler(int quantum) : time_quantum(quantum), current_time(0) {}
+    Scheduler(const PolicyFactory& make, const MachineConfig& machine = {}, unsigned seed = 1,
+              bool verbose = false)
+        : cpus(std::max(1, machine.cpus)), devices(std::max(1, machine.devices)), current_time(0),
+          machine(machine), preemptions(0), placement(seed), source(nullptr), last_arrival(0),
+          verbose(verbose), mmu(machine.paging, cpus.size()),
+          threads(machine.threads) {
+        for (size_t c = 0; c < cpus.size(); ++c) {
+            cpus[c].policy = make(c);
+            cpus[c].policy->attach(processes);
+        }
+        for (Device& d : devices)
+            d.queue.attach(processes);
+        swap.queue.attach(processes);
+        frame_waiters.attach(processes);
+    }
 
-    // Add process to ready queue
+    // Add process; it joins a ready queue at its arrival time
     void add_process(Process p) {
         std::lock_guard<std::mutex> lock(queue_mutex);
-        ready_queue.push_back(p);
+        admit(std::move(p));
     }
 
-    // Run round-robin scheduling
-    void run_round_robin() {
-        while (!ready_queue.empty()) {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            if (ready_queue.empty()) break;
-
-            Process& proc = ready_queue.front();
-            ready_queue.erase(ready_queue.begin());
+    // Run until every process, those added and those workload yields, has
+    // finished
+    void run(WorkloadSource* workload = nullptr) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        source = workload;
+        admit_next();
+        if ((machine.balance & BALANCE_PERIODIC) && cpus.size() > 1)
+            events.schedule(machine.balance_interval, EventType::REBALANCE, -1);
+        while (!events.empty()) {
+            Event e = events.pop();
+            current_time = e.time;
+            switch (e.type) {
+            case EventType::ARRIVAL:
+                admit_next();
+                // Forked wherever the parent happened to be running
+                wake(e.proc, cpus.size() > 1 ? int(placement() % cpus.size()) : 0);
+                break;
+            case EventType::SLICE_END:
+                if (e.gen == cpus[e.cpu].slice_gen) end_slice(e.cpu);
+                break;
+            case EventType::IO_DONE:
+                end_io(e.cpu, e.proc);
+                break;
+            case EventType::REBALANCE:
+                rebalance();
+                if (!events.empty())
+                    events.schedule(current_time + machine.balance_interval, EventType::REBALANCE, -1);
+                break;
+            }
+            for (size_t c = 0; c < cpus.size(); ++c)
+                dispatch(c);
+        }
+    }
 
-            // Context switch: Restore state
-            mmu.restore_state(proc);
-            proc.state = ProcessState::RUNNING;
+    Metrics metrics() const {
+        Metrics m;
+        for (const Cpu& cpu : cpus) {
+            m.utilization.push_back(current_time > 0 ? double(cpu.busy) / current_time : 0);
+            m.migrations += cpu.migrations;
+        }
+        Time queue_delay = 0;
+        for (const Device& d : devices) {
+            m.device_utilization.push_back(current_time > 0 ? double(d.busy) / current_time : 0);
+            m.io_requests += d.requests;
+            queue_delay += d.queue_delay;
+        }
+        if (m.io_requests) m.io_queue_delay = double(queue_delay) / m.io_requests;
 
-            // Run for quantum or until done
-            int run_time = std::min(time_quantum, proc.remaining_time);
-            proc.execute(run_time);
-            current_time += run_time;
+        size_t n = m.completed = done.n;
+        m.paging = mmu.paging_stats();
+        if (current_time > 0) m.swap_utilization = double(swap.busy) / current_time;
+        if (swap.requests) m.swap_queue_delay = double(swap.queue_delay) / swap.requests;
+        if (current_time > 0) m.throughput = 1000.0 * done.n / current_time;
+        if (n == 0) return m;
+        m.turnaround = done.turnaround / n;
+        m.response = done.response / n;
+        m.waiting = done.waiting / n;
+        m.fairness = done.slowdown * done.slowdown / (n * done.slowdown2);
+        m.weighted_fairness = done.wslowdown * done.wslowdown / (n * done.wslowdown2);
+        m.interactive = done.interactive;
+        if (m.interactive) m.interactive_response = done.interactive_response / m.interactive;
+        if (n > size_t(m.interactive)) m.batch_turnaround = done.batch_turnaround / (n - m.interactive);
+        std::vector<float> responses = done.responses;
+        auto p99 = responses.begin() + std::min(n - 1, size_t(0.99 * n));
+        std::nth_element(responses.begin(), p99, responses.end());
+        m.p99_response = *p99;
+        m.max_response = *std::max_element(p99, responses.end());
+        return m;
+    }
 
-            // Update metrics
-            if (proc.state == ProcessState::TERMINATED) {
-                proc.completion_time = current_time;
-                std::cout << "Process " << proc.pid << " finished at "
-                          << current_time << " ms\n";
-            } else {
-                // Preempt: Save state, back to ready queue
-                mmu.save_state(proc);
-                proc.state = ProcessState::READY;
-                ready_queue.push_back(proc);
+    // Print scheduling metrics
+    void print_metrics() const {
+        Metrics m = metrics();
+        std::cout << "Average Turnaround: " << m.turnaround << " ms\n";
+        std::cout << "Average Response: " << m.response << " ms (p99 " << m.p99_response
+                  << " ms, max " << m.max_response << " ms)\n";
+        std::cout << "Average Waiting: " << m.waiting << " ms\n";
+        std::cout << "Fairness (Jain, slowdown): " << m.fairness << ", weighted by share: "
+                  << m.weighted_fairness << "\n";
+        if (m.interactive)
+            std::cout << "Interactive response: " << m.interactive_response
+                      << " ms, batch turnaround: " << m.batch_turnaround << " ms\n";
+        if (cpus.size() > 1) {
+            for (size_t c = 0; c < cpus.size(); ++c)
+                std::cout << "CPU " << c << ": utilization " << 100 * m.utilization[c] << "%, "
+                          << cpus[c].dispatches << " dispatches, "
+                          << cpus[c].migrations << " migrated in\n";
+            std::cout << "Migrations: " << m.migrations << " (" << machine.migration_cost << " ms each)\n";
+        }
+        if (m.io_requests) {
+            for (size_t d = 0; d < devices.size(); ++d)
+                std::cout << "Device " << d << ": utilization " << 100 * m.device_utilization[d]
+                          << "%, " << devices[d].requests << " requests\n";
+            std::cout << "I/O queueing delay: " << m.io_queue_delay << " ms per request\n";
+        }
+        if (mmu.enabled()) {
+            const PagingConfig& pc = mmu.paging();
+            const PagingStats& ps = m.paging;
+            uint64_t refills = ps.walks - ps.compulsory - ps.major_faults;
+            std::cout << "Paging: " << pc.levels << "-level tables, "
+                      << (pc.page_shift < 20 ? 1 << (pc.page_shift - 10) : 1 << (pc.page_shift - 20))
+                      << (pc.page_shift < 20 ? " KiB" : " MiB") << " pages, "
+                      << pc.tlb_sets << "x" << pc.tlb_ways << " TLB per CPU, "
+                      << (pc.asid ? "ASID-tagged" : "flushed on switch") << "\n";
+            std::cout << "TLB hit rate: " << 100.0 * ps.tlb_hits / std::max<uint64_t>(1, ps.accesses)
+                      << "% of " << ps.accesses << " references; " << ps.walks << " walks ("
+                      << ps.compulsory << " first touch), " << ps.walk_refs << " walk memory references\n";
+            std::cout << "Context switches: " << ps.switches << ", " << ps.flushes << " TLB flushes, "
+                      << ps.rollovers << " ASID rollovers; " << double(refills) / std::max<uint64_t>(1, ps.switches)
+                      << " refill walks (" << double(refills) * pc.walk_depth() / std::max<uint64_t>(1, ps.switches)
+                      << " memory references) per switch\n";
+            if (pc.frames) {
+                std::cout << "Memory: " << pc.frames << " frames (" << (uint64_t(pc.frames) << pc.page_shift >> 20)
+                          << " MiB), " << mmu.replacement_name() << " replacement, peak resident "
+                          << ps.peak_resident << " pages\n";
+                std::cout << "Faults: " << ps.compulsory << " first touch, " << ps.major_faults << " major ("
+                          << 1000.0 * ps.major_faults / std::max<uint64_t>(1, ps.accesses)
+                          << " per 1000 references); " << ps.evictions << " evictions, "
+                          << ps.writebacks << " written back\n";
+                std::cout << "Swap: utilization " << 100 * m.swap_utilization << "%, "
+                          << m.swap_queue_delay << " ms queueing per page-in\n";
             }
+        }
+        if (threads.enabled()) {
+            const ThreadConfig& tc = threads.thread_config();
+            const ThreadStats& ts = threads.thread_stats();
+            std::cout << "Threads: " << tc.mode << ", " << (tc.stack_size >> 10)
+                      << " KiB stacks with a guard page, " << tc.us_per_ms << " us of work per ms; "
+                      << ts.work_us / 1000.0 << " ms of work done\n";
+            std::cout << "Thread switches: " << ts.switches_in << " in, "
+                      << ts.ns_in / std::max<uint64_t>(1, ts.switches_in) << " ns each; "
+                      << ts.switches_out << " out, " << ts.ns_out / std::max<uint64_t>(1, ts.switches_out)
+                      << " ns each";
+            if (tc.mode == "timer") std::cout << "; " << ts.timer_preemptions << " timer preemptions";
+            std::cout << "\n";
+        }
+        std::cout << "Throughput: " << m.throughput << " processes/s\n";
+    }
 
-            // Simulate waiting time for others
-            for (auto& p : ready_queue) {
-                if (p.state == ProcessState::READY) {
-                    p.waiting_time += run_time;
-                }
+    const char* policy_name() const { return cpus[0].policy->name(); }
+    uint64_t decisions_made() const {
+        uint64_t n = 0;
+        for (const Cpu& cpu : cpus) n += cpu.dispatches;
+        return n;
+    }
+    uint64_t preemptions_made() const { return preemptions; }
+    Time now() const { return current_time; }
+
+private:
+    // Gives p a slot, reusing one of an exited process, and schedules its arrival
+    void admit(Process p) {
+        int idx;
+        if (free_slots.empty()) {
+            idx = processes.size();
+            processes.push_back(std::move(p));
+        } else {
+            idx = free_slots.back();
+            free_slots.pop_back();
+            processes[idx] = std::move(p);
+        }
+        events.schedule(processes[idx].arrival_time, EventType::ARRIVAL, idx);
+    }
+
+    // Reads the next process from the workload, if any
+    void admit_next() {
+        if (!source) return;
+        std::optional<Process> p = source->next();
+        if (!p) {
+            source = nullptr;
+            return;
+        }
+        if (p->arrival_time < last_arrival)
+            throw std::runtime_error("workload out of order: process " + std::to_string(p->pid) +
+                                     " arrives before the one before it");
+        last_arrival = p->arrival_time;
+        admit(std::move(*p));
+    }
+
+    // Queue a process on CPU c, noting when, so its wait can be charged on
+    // the way out. Push balancing may send a waking process elsewhere; a
+    // preempted one stays where its cache is. Returns the CPU.
+    int make_ready(int idx, int c, bool wakeup) {
+        if (wakeup && (machine.balance & BALANCE_PUSH)) {
+            int least = c;
+            for (size_t o = 0; o < cpus.size(); ++o)
+                if (cpus[o].load() < cpus[least].load()) least = o;
+            c = least;
+        }
+        Process& proc = processes[idx];
+        proc.state = ProcessState::READY;
+        proc.enqueued_at = current_time;
+        cpus[c].policy->enqueue(idx, current_time);
+        return c;
+    }
+
+    // An arriving or unblocked process becomes ready, near CPU c, and may
+    // preempt what runs there
+    void wake(int idx, int c) {
+        c = make_ready(idx, c, true);
+        Cpu& cpu = cpus[c];
+        if (cpu.running >= 0 && cpu.policy->preempts(idx, cpu.running, progress(cpu)))
+            preempt(c);
+    }
+
+    // Ran so far in the current slice, not counting the cache warm-up
+    int progress(const Cpu& cpu) const {
+        return std::max(0, int(current_time - cpu.slice_start) - cpu.warmup);
+    }
+
+    // Idle CPU and a ready process: context switch to the one the policy
+    // picks, or with pull balancing to one stolen from the busiest CPU
+    void dispatch(int c) {
+        Cpu& cpu = cpus[c];
+        if (cpu.running >= 0) return;
+        if (cpu.policy->empty() && (machine.balance & BALANCE_PULL)) steal_for(c);
+        int next = cpu.policy->pick_next(current_time);
+        if (next < 0) return;
+
+        Process& proc = processes[next];
+        proc.waiting_time += current_time - proc.enqueued_at;
+        if (proc.first_run < 0) {
+            proc.first_run = current_time;
+            threads.start(next);
+        }
+
+        // A process that last ran elsewhere first refills this CPU's cache
+        cpu.warmup = 0;
+        if (proc.cpu >= 0 && proc.cpu != c) {
+            cpu.warmup = machine.migration_cost;
+            ++cpu.migrations;
+        }
+        proc.cpu = c;
+
+        // Context switch: Restore state
+        mmu.restore_state(c, next, proc);
+        proc.state = ProcessState::RUNNING;
+        cpu.running = next;
+        cpu.slice_start = current_time;
+        ++cpu.dispatches;
+
+        // Run for the policy's slice or until the burst is done. Its memory
+        // references are made now, and may fault partway, ending the slice
+        // early to wait for swap. With real threads, its thread runs now too.
+        int run_time = std::min(cpu.policy->time_slice(next), proc.remaining_time);
+        run_time = mmu.run(c, next, run_time, cpu.stall);
+        threads.run(next, run_time);
+        run_time += cpu.warmup;
+        events.schedule(current_time + run_time, EventType::SLICE_END, next, ++cpu.slice_gen, c);
+    }
+
+    // Moves a ready process from the most loaded other CPU to c's queue
+    void steal_for(int c) {
+        int busiest = -1;
+        for (size_t o = 0; o < cpus.size(); ++o)
+            if (int(o) != c && !cpus[o].policy->empty() &&
+                (busiest < 0 || cpus[o].load() > cpus[busiest].load()))
+                busiest = o;
+        if (busiest >= 0)
+            cpus[c].policy->enqueue(cpus[busiest].policy->steal(), current_time);
+    }
+
+    // Periodic balancing: even out queue lengths to within one
+    void rebalance() {
+        for (;;) {
+            int busiest = 0, idlest = 0;
+            for (size_t c = 1; c < cpus.size(); ++c) {
+                if (cpus[c].load() > cpus[busiest].load()) busiest = c;
+                if (cpus[c].load() < cpus[idlest].load()) idlest = c;
             }
+            if (cpus[busiest].load() < cpus[idlest].load() + 2) return;
+            int idx = cpus[busiest].policy->steal();
+            if (idx < 0) return;
+            cpus[idlest].policy->enqueue(idx, current_time);
+        }
+    }
+
+    // Take the CPU from its running process: charge what it ran so far. A
+    // preempted process never reached the fault its slice was to end in.
+    void stop_running(int c, bool preempted) {
+        Cpu& cpu = cpus[c];
+        Process& proc = processes[cpu.running];
+        int ran = int(current_time - cpu.slice_start);
+        int stall = preempted ? 0 : cpu.stall;
+        bool freed = cpu.stall && !stall && mmu.cancel_fault(cpu.running);
+        cpu.stall = 0;
+        proc.execute(progress(cpu));
+        cpu.policy->charge(cpu.running, ran, current_time);
+        cpu.busy += ran;
+        int idx = cpu.running;
+        cpu.running = -1;
+        // Context switch: Save state, whatever comes next
+        mmu.save_state(c, idx);
 
-            // Simulate CPU tick
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        // Update metrics
+        if (proc.state == ProcessState::TERMINATED) {
+            proc.completion_time = current_time;
+            finish(idx);
+        } else if (proc.state == ProcessState::BLOCKED) {
+            // End of a CPU burst: off to its device
+            block_on(proc.pid % devices.size(), idx);
+        } else if (stall == MMU::NO_FRAME) {
+            // Page fault with every frame held for a page-in: wait for one
+            proc.state = ProcessState::BLOCKED;
+            frame_waiters.push_back(idx);
+        } else if (stall) {
+            // Page fault: wait for the swap device
+            proc.state = ProcessState::BLOCKED;
+            proc.swap_wait = stall;
+            block_on(-1, idx);
+        } else {
+            // Preempt: back to ready queue
+            make_ready(idx, c, false);
         }
+        if (freed) wake_frame_waiters();
     }
 
-    // Print scheduling metrics
-    void print_metrics(const std::vector<Process>& processes) {
-        double avg_turnaround = 0, avg_waiting = 0;
-        for (const auto& p : processes) {
-            int turnaround = p.completion_time - p.arrival_time;
-            avg_turnaround += turnaround;
-            avg_waiting += p.waiting_time;
-            std::cout << "Process " << p.pid << ": Turnaround = " << turnaround
-                      << " ms, Waiting = " << p.waiting_time << " ms\n";
+    // A frame may have come free, or become evictable: every process waiting
+    // for one retries its fault, and those that still find none wait again
+    void wake_frame_waiters() {
+        while (!frame_waiters.empty()) {
+            int idx = frame_waiters.pop_front();
+            wake(idx, processes[idx].cpu);
         }
-        avg_turnaround /= processes.size();
-        avg_waiting /= processes.size();
-        std::cout << "Average Turnaround: " << avg_turnaround << " ms\n";
-        std::cout << "Average Waiting: " << avg_waiting << " ms\n";
+    }
+
+    // I/O device d, or the swap device when d < 0
+    Device& device(int d) { return d < 0 ? swap : devices[d]; }
+
+    // Blocked process: queue for device d, or start at once when it's idle
+    void block_on(int d, int idx) {
+        Device& dev = device(d);
+        processes[idx].enqueued_at = current_time;
+        if (dev.serving < 0) serve(d, idx);
+        else dev.queue.push_back(idx);
+    }
+
+    void serve(int d, int idx) {
+        Device& dev = device(d);
+        Process& proc = processes[idx];
+        int io_time = d < 0 ? proc.swap_wait : proc.start_io();
+        dev.serving = idx;
+        dev.busy += io_time;
+        dev.queue_delay += current_time - proc.enqueued_at;
+        ++dev.requests;
+        events.schedule(current_time + io_time, EventType::IO_DONE, idx, 0, d);
+    }
+
+    // Device d finished idx's I/O: start the next request, and idx goes back
+    // to the CPU it last ran on
+    void end_io(int d, int idx) {
+        Device& dev = device(d);
+        dev.serving = -1;
+        if (!dev.queue.empty()) serve(d, dev.queue.pop_front());
+        if (d >= 0) processes[idx].end_io();
+        else mmu.page_in_done(idx);
+        wake(idx, processes[idx].cpu);
+        if (d < 0) wake_frame_waiters();
+    }
+
+    // idx has exited: fold it into the totals and free its slot
+    void finish(int idx) {
+        const Process& p = processes[idx];
+        double turnaround = p.completion_time - p.arrival_time;
+        double response = p.first_run - p.arrival_time;
+        double slowdown = turnaround / std::max(1, p.burst_time);
+        ++done.n;
+        done.turnaround += turnaround;
+        done.response += response;
+        done.waiting += p.waiting_time;
+        done.responses.push_back(response);
+        done.slowdown += slowdown;
+        done.slowdown2 += slowdown * slowdown;
+        // A process with twice the weight should see half the slowdown
+        double wslowdown = slowdown * p.weight / 1024;
+        done.wslowdown += wslowdown;
+        done.wslowdown2 += wslowdown * wslowdown;
+        if (p.interactive) {
+            ++done.interactive;
+            done.interactive_response += response;
+        } else {
+            done.batch_turnaround += turnaround;
+        }
+        if (verbose)
+            std::cout << "Process " << p.pid << " finished at " << current_time
+                      << " ms: Turnaround = " << turnaround << " ms, Response = "
+                      << response << " ms, Waiting = " << p.waiting_time << " ms\n";
+
+        for (Cpu& cpu : cpus)
+            cpu.policy->release(idx);
+        mmu.release(idx);
+        std::vector<int>().swap(processes[idx].bursts);
+        free_slots.push_back(idx);
+        wake_frame_waiters();
+    }
+
+    // The running process's slice is over: it finished, blocks, or goes back
+    void end_slice(int c) { stop_running(c, false); }
+
+    // A new arrival outranks the running process: cut its slice short
+    void preempt(int c) {
+        ++cpus[c].slice_gen;    // The pending SLICE_END no longer applies
+        ++preemptions;
+        stop_running(c, true);
     }
 };
 
-// Main simulation driver
-int main() {
-    // Seed random number generator
-    srand(static_cast<unsigned>(time(nullptr)));
+using WorkloadFactory = std::function<std::unique_ptr<WorkloadSource>()>;
+
+// Runs a fresh copy of the workload under policy; returns the scheduler
+// for its metrics
+std::unique_ptr<Scheduler> simulate(const std::string& policy, const WorkloadFactory& workload,
+                                    int quantum, const MachineConfig& machine, unsigned seed,
+                                    bool verbose, double& wall_s) {
+    auto scheduler = std::make_unique<Scheduler>(
+        [&](int cpu) { return make_policy(policy, quantum, seed + cpu); }, machine, seed, verbose);
+    std::unique_ptr<WorkloadSource> source = workload();
+    auto start = std::chrono::steady_clock::now();
+    scheduler->run(source.get());
+    wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return scheduler;
+}
 
-    // Create scheduler with 10 ms quantum
-    Scheduler scheduler(10);
+// Memory pressure sweep: runs the workload with memory unlimited to find
+// the peak resident set, then with 100% down to 10% of that, and writes
+// frames,mib,major_per_1k_refs,major_faults,throughput,cpu_util,swap_util
+// CSV. Thrashing sets in where CPU utilization falls under half of what it
+// was with memory unlimited: processes spend their time waiting for swap.
+void memory_sweep(const std::string& policy, const WorkloadFactory& workload, int quantum,
+                  MachineConfig machine, unsigned seed) {
+    auto cpu_util = [](const Metrics& m) {
+        double sum = 0;
+        for (double u : m.utilization) sum += u;
+        return sum / m.utilization.size();
+    };
+    double wall;
+    machine.paging.frames = 0;
+    Metrics unlimited = simulate(policy, workload, quantum, machine, seed, false, wall)->metrics();
+    const uint64_t peak = unlimited.paging.peak_resident;
+    const int shift = machine.paging.page_shift;
 
-    // Create 5 processes with random burst times (10–100 ms)
-    std::vector<Process> processes;
-    for (int i = 0; i < 5; ++i) {
-        int burst = 10 + (rand() % 91); // 10–100 ms
-        Process p(i, burst, 0); // Arrival time = 0
-        processes.push_back(p);
-        scheduler.add_process(p);
+    std::printf("# policy %s, %s replacement, swap %d ms per page, peak resident %llu pages (%llu MiB)\n",
+                policy.c_str(), machine.paging.replacement.c_str(), machine.paging.swap_ms,
+                (unsigned long long)peak, (unsigned long long)(peak << shift >> 20));
+    std::printf("# unlimited: throughput %.3f processes/s, CPU utilization %.3f\n",
+                unlimited.throughput, cpu_util(unlimited));
+    std::printf("frames,mib,major_per_1k_refs,major_faults,throughput,cpu_util,swap_util\n");
+    long onset = -1;
+    for (int pct = 100; pct >= 10; pct -= 10) {
+        machine.paging.frames = int(std::max<uint64_t>(16, peak * pct / 100));
+        Metrics m = simulate(policy, workload, quantum, machine, seed, false, wall)->metrics();
+        std::printf("%d,%.1f,%.3f,%llu,%.3f,%.3f,%.3f\n", machine.paging.frames,
+                    double(uint64_t(machine.paging.frames) << shift) / (1 << 20),
+                    1000.0 * m.paging.major_faults / std::max<uint64_t>(1, m.paging.accesses),
+                    (unsigned long long)m.paging.major_faults, m.throughput, cpu_util(m),
+                    m.swap_utilization);
+        std::fflush(stdout);
+        if (onset < 0 && cpu_util(m) < cpu_util(unlimited) / 2) onset = machine.paging.frames;
     }
+    if (onset >= 0)
+        std::printf("# thrashing onset: %ld frames (%.1f MiB)\n", onset,
+                    double(uint64_t(onset) << shift) / (1 << 20));
+    else
+        std::printf("# no thrashing down to 10%% of the peak resident set\n");
+}
 
-    // Run simulation
-    std::cout << "Starting simulation...\n";
-    scheduler.run_round_robin();
+// Main simulation driver
+// usage: proc-sim [-p policy|all] [-t trace | -n processes -k cpu_bursts -i interactive_fraction
+//                 [-N interactive_nice] -a mean_interarrival_ms] [-q quantum_ms] [-c cpus] [-b push,pull,periodic|none]
+//                 [-m migration_cost_ms] [-B balance_interval_ms] [-d devices]
+//                 [-L levels [-P 4k|2m|1g] [-T setsxways] [-F] [-r refs_per_ms]]
+//                 [-f frames|sweep [-e fifo|lru|clock|arc|ws] [-S swap_ms] [-W ws_window_ms]]
+//                 [-x memory_trace] [-u coop|timer [-U us_per_ms]] [-w trace_out] [-s seed] [-v]
+//   policies: fifo sjf stcf rr mlfq lottery stride cfs; "all" runs each on
+//   the same workload and prints a comparison
+//   -N runs the interactive processes at that nice (-20..19; batch ones
+//   are at 0), which sets their lottery tickets, stride and CFS weight;
+//   traces can give each process a nice
+//   -t reads the workload from a trace (see TraceReader) instead of
+//   generating it; -w writes the workload out as a trace (binary if the
+//   name ends in .bin) and exits
+//   -L simulates paging with 2–4 level page tables and a TLB per CPU,
+//   ASID-tagged or, with -F, flushed whenever a process comes off a CPU
+//   -f limits physical memory to that many page frames, backed by swap, or
+//   with "sweep" finds where the workload starts thrashing; -x drives the
+//   memory references from a valgrind lackey trace (see load_ref_trace)
+//   -u runs each process as a real user-level thread (see UserThreads),
+//   switched out when it yields or by a timer signal, and compares the
+//   switches with those between kernel threads
+int main(int argc, char** argv) {
+    std::string policy = "rr";
+    std::string trace, trace_out;
+    std::string frames, ref_trace;
+    int nprocs = 5;
+    int cpu_bursts = 1;
+    int quantum = 10;
+    double interactive = 0, interarrival = 0;
+    int interactive_nice = 0;
+    MachineConfig machine;
+    unsigned seed = static_cast<unsigned>(time(nullptr));
+    int verbose = -1;   // default: per-process output for small runs only
 
-    // Print metrics
-    std::cout << "\nSimulation complete.\n";
-    scheduler.print_metrics(processes);
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:n:k:q:i:N:a:c:b:m:B:d:L:P:T:Fr:f:e:S:W:x:u:U:w:s:v")) != -1) {
+        switch (opt) {
+        case 'p': policy = optarg; break;
+        case 't': trace = optarg; break;
+        case 'n': nprocs = std::max(1, std::atoi(optarg)); break;
+        case 'k': cpu_bursts = std::max(1, std::atoi(optarg)); break;
+        case 'q': quantum = std::max(1, std::atoi(optarg)); break;
+        case 'i': interactive = std::atof(optarg); break;
+        case 'N': interactive_nice = std::clamp(std::atoi(optarg), -20, 19); break;
+        case 'a': interarrival = std::atof(optarg); break;
+        case 'c': machine.cpus = std::max(1, std::atoi(optarg)); break;
+        case 'b':
+            machine.balance = parse_balance(optarg);
+            if (machine.balance < 0) {
+                std::cerr << "unknown balancing " << optarg << "; push, pull, periodic or none\n";
+                return 1;
+            }
+            break;
+        case 'm': machine.migration_cost = std::max(0, std::atoi(optarg)); break;
+        case 'B': machine.balance_interval = std::max(1, std::atoi(optarg)); break;
+        case 'd': machine.devices = std::max(1, std::atoi(optarg)); break;
+        case 'L': machine.paging.levels = std::atoi(optarg); break;
+        case 'P':
+            machine.paging.page_shift = std::tolower(optarg[std::strlen(optarg) - 1]) == 'g' ? 30
+                                      : std::tolower(optarg[std::strlen(optarg) - 1]) == 'm' ? 21 : 12;
+            break;
+        case 'T':
+            if (std::sscanf(optarg, "%dx%d", &machine.paging.tlb_sets, &machine.paging.tlb_ways) != 2)
+                machine.paging.tlb_sets = 0;
+            break;
+        case 'F': machine.paging.asid = false; break;
+        case 'r': machine.paging.refs_per_ms = std::max(1, std::atoi(optarg)); break;
+        case 'f': frames = optarg; break;
+        case 'e': machine.paging.replacement = optarg; break;
+        case 'S': machine.paging.swap_ms = std::max(0, std::atoi(optarg)); break;
+        case 'W': machine.paging.ws_window_ms = std::max(1, std::atoi(optarg)); break;
+        case 'x': ref_trace = optarg; break;
+        case 'u': machine.threads.mode = optarg; break;
+        case 'U': machine.threads.us_per_ms = std::max(1, std::atoi(optarg)); break;
+        case 'w': trace_out = optarg; break;
+        case 's': seed = static_cast<unsigned>(std::strtoul(optarg, nullptr, 0)); break;
+        case 'v': verbose = 1; break;
+        default:
+            std::cerr << "usage: " << argv[0] << " [-p policy|all] [-t trace | -n processes"
+                         " -k cpu_bursts -i interactive_fraction [-N interactive_nice] -a mean_interarrival_ms]"
+                         " [-q quantum_ms] [-c cpus] [-b push,pull,periodic|none]"
+                         " [-m migration_cost_ms] [-B balance_interval_ms] [-d devices]"
+                         " [-L levels [-P 4k|2m|1g] [-T setsxways] [-F] [-r refs_per_ms]]"
+                         " [-f frames|sweep [-e fifo|lru|clock|arc|ws] [-S swap_ms] [-W ws_window_ms]]"
+                         " [-x memory_trace] [-u coop|timer [-U us_per_ms]] [-w trace_out] [-s seed] [-v]\n";
+            return 1;
+        }
+    }
+    if (policy != "all" && !make_policy(policy, quantum)) {
+        std::cerr << "unknown policy " << policy << "; one of:";
+        for (const char* name : policy_names) std::cerr << " " << name;
+        std::cerr << " all\n";
+        return 1;
+    }
+    // Limited memory and memory traces need paging
+    if (frames != "sweep") machine.paging.frames = std::max(0, std::atoi(frames.c_str()));
+    if ((!frames.empty() || !ref_trace.empty()) && !machine.paging.levels) machine.paging.levels = 4;
+    if (!make_replacement(machine.paging.replacement, 1, 1)) {
+        std::cerr << "unknown replacement policy " << machine.paging.replacement << "; one of:";
+        for (const char* name : replacement_names) std::cerr << " " << name;
+        std::cerr << "\n";
+        return 1;
+    }
+    const std::string& mode = machine.threads.mode;
+    if (!mode.empty() && mode != "coop" && mode != "timer") {
+        std::cerr << "unknown thread mode " << mode << "; coop or timer\n";
+        return 1;
+    }
+    if (frames == "sweep" && policy == "all") {
+        std::cerr << "sweep one policy at a time\n";
+        return 1;
+    }
+    const PagingConfig& paging = machine.paging;
+    if (paging.levels && (paging.levels < 2 || paging.levels > 4 || paging.walk_depth() < 1)) {
+        std::cerr << "paging needs 2-4 levels, and at least one left to walk: 2m pages skip one, 1g two\n";
+        return 1;
+    }
+    if (paging.levels && (paging.tlb_sets < 1 || (paging.tlb_sets & (paging.tlb_sets - 1)) ||
+                          paging.tlb_ways < 1)) {
+        std::cerr << "TLB must be SETSxWAYS with a power-of-two number of sets\n";
+        return 1;
+    }
+    if (verbose < 0) verbose = trace.empty() && nprocs <= 20 && policy != "all";
+
+    WorkloadFactory workload = [&]() -> std::unique_ptr<WorkloadSource> {
+        if (!trace.empty()) return std::make_unique<TraceReader>(trace);
+        return std::make_unique<GeneratedWorkload>(nprocs, interactive, interarrival, cpu_bursts, seed,
+                                                   interactive_nice);
+    };
+
+    try {
+        if (!trace_out.empty()) {
+            write_trace(*workload(), trace_out);
+            return 0;
+        }
+        if (!ref_trace.empty()) machine.paging.refs = load_ref_trace(ref_trace);
+        if (frames == "sweep") {
+            memory_sweep(policy, workload, quantum, machine, seed);
+            return 0;
+        }
+
+        if (policy == "all") {
+            std::cout << std::left << std::setw(9) << "policy" << std::right
+                      << std::setw(12) << "turnaround" << std::setw(10) << "response"
+                      << std::setw(10) << "p99_resp" << std::setw(10) << "waiting"
+                      << std::setw(10) << "fairness" << std::setw(10) << "w_fair" << std::setw(12) << "int_resp"
+                      << std::setw(12) << "batch_tat" << std::setw(12) << "preempts"
+                      << std::setw(12) << "migrations" << std::setw(10) << "min_util"
+                      << std::setw(14) << "decisions/s" << "\n";
+            std::cout << std::fixed << std::setprecision(1);
+            for (const char* name : policy_names) {
+                double wall;
+                auto s = simulate(name, workload, quantum, machine, seed, false, wall);
+                Metrics m = s->metrics();
+                std::cout << std::left << std::setw(9) << name << std::right
+                          << std::setw(12) << m.turnaround << std::setw(10) << m.response
+                          << std::setw(10) << m.p99_response << std::setw(10) << m.waiting
+                          << std::setprecision(3) << std::setw(10) << m.fairness
+                          << std::setw(10) << m.weighted_fairness << std::setprecision(1)
+                          << std::setw(12) << m.interactive_response << std::setw(12) << m.batch_turnaround
+                          << std::setw(12) << s->preemptions_made() << std::setw(12) << m.migrations
+                          << std::setprecision(3) << std::setw(10)
+                          << *std::min_element(m.utilization.begin(), m.utilization.end())
+                          << std::setw(14) << std::setprecision(0) << s->decisions_made() / wall
+                          << std::setprecision(1) << "\n";
+            }
+            return 0;
+        }
+
+        // Run simulation
+        std::cout << "Starting simulation (" << policy << ", " << machine.cpus << " CPU"
+                  << (machine.cpus > 1 ? "s" : "") << ")...\n";
+        double wall;
+        auto scheduler = simulate(policy, workload, quantum, machine, seed, verbose, wall);
+
+        // Print metrics
+        std::cout << "\nSimulation complete.\n";
+        scheduler->print_metrics();
+        std::cout << scheduler->decisions_made() << " scheduling decisions over "
+                  << scheduler->now() << " ms simulated in " << wall << " s ("
+                  << scheduler->decisions_made() / wall << " decisions/s)\n";
+        if (!machine.threads.mode.empty())
+            std::cout << "Context switch: ucontext " << ucontext_switch_ns(100000)
+                      << " ns, kernel threads " << kernel_switch_ns(20000)
+                      << " ns (futex hand-off on one CPU)\n";
+    } catch (const std::exception& e) {
+        std::cerr << "proc-sim: " << e.what() << "\n";
+        return 1;
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "include/affinity.h"
+#include "include/cache_info.h"
+#include "include/bench.h"
+
+// Prefetcher and stride sensitivity. Loads 8 bytes every stride bytes, for
+// strides from 8 B to 64 KiB, over a buffer well past the last-level cache,
+// in four patterns:
+//   forward   increasing addresses
+//   backward  decreasing addresses
+//   tiled     8 rows stride bytes apart, walked down each column of lines
+//             in turn, like a tile of a row-major matrix read by columns
+//   page      the stride slots of each 4 KiB page in a random order, pages in
+//             order: what a prefetcher that follows pages but not strides sees
+// Then forward again with __builtin_prefetch a distance of 1..64 strides
+// ahead. Every point runs twice: "indep", where the loads are independent
+// and the prefetcher competes with out-of-order execution, and "dep", where
+// each address depends on the last load so only a prefetch can hide the
+// latency. Each pass starts a line further into the stride, so that large
+// strides don't keep reloading the same few lines. Writes
+//   pattern,stride,prefetch,mode,ns_per_access,ci_lo,ci_hi
+// CSV; prefetch is the software prefetch distance in strides (0: none). Each
+// point runs under the include/bench.h harness: ns_per_access is the median
+// and ci_lo..ci_hi its confidence interval.
+//
+// usage: stride [-c core] [-m bytes] [-n accesses] [-p forward,backward,tiled,page,prefetch] [-o out.csv]
+//               [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]
+
+using Clock = std::chrono::steady_clock;
+
+// Loads the 8 bytes at buf + off. When Dep, the address also adds the last
+// value loaded (always 0, which the compiler can't know), so every load waits
+// for the one before.
+template <bool Dep>
+struct Access
+{
+    const uint8_t *buf;
+    uint64_t carry = 0;
+
+    inline void operator()(size_t off) {
+        uint64_t v = *reinterpret_cast<const volatile uint64_t *>(buf + off + (Dep ? carry : 0));
+        carry = Dep ? v : carry + v;
+    }
+};
+
+volatile uint64_t carry_sink;
+
+enum class Pattern { Forward, Backward, Tiled, Page };
+
+// One timed run of accesses loads; ns per access
+template <bool Dep>
+double run(Pattern pattern, const uint8_t *buf, size_t bytes, size_t stride, int prefetch,
+           long long accesses, size_t line, const std::vector<size_t> &page_order) {
+    Access<Dep> a{buf};
+    const size_t page = 4096;
+    long long done = 0;
+    auto t0 = Clock::now();
+    for (size_t pass = 0; done < accesses; ++pass) {
+        const size_t start = (pass * line) % stride;
+        switch (pattern) {
+        case Pattern::Forward:
+        case Pattern::Backward: {
+            long long n = std::min<long long>((bytes - 8 - start) / stride + 1, accesses - done);
+            if (pattern == Pattern::Forward && prefetch > 0) {
+                const size_t ahead = prefetch * stride;
+                for (long long i = 0; i < n; ++i) {
+                    __builtin_prefetch(buf + start + i * stride + ahead);
+                    a(start + i * stride);
+                }
+            } else if (pattern == Pattern::Forward) {
+                for (long long i = 0; i < n; ++i)
+                    a(start + i * stride);
+            } else {
+                for (long long i = n - 1; i >= 0; --i)
+                    a(start + i * stride);
+            }
+            done += n;
+            break;
+        }
+        case Pattern::Tiled: {
+            const size_t rows = 8;
+            for (size_t band = 0; (band + 1) * rows * stride <= bytes && done < accesses; ++band) {
+                const size_t base = band * rows * stride;
+                for (size_t col = 0; col < stride; col += line)
+                    for (size_t r = 0; r < rows; ++r)
+                        a(base + r * stride + col);
+                done += rows * ((stride + line - 1) / line);
+            }
+            break;
+        }
+        case Pattern::Page: {
+            // Slots of one span (a page, or one stride when it's bigger)
+            const size_t span = std::max(page, stride);
+            for (size_t base = start; base + span <= bytes && done < accesses; base += span) {
+                for (size_t slot : page_order)
+                    a(base + slot);
+                done += page_order.size();
+            }
+            break;
+        }
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    carry_sink = a.carry;
+    return ns / done;
+}
+
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.warmup = 1;
+    opts.reps = 5;
+    opts = bench::parse_args(argc, argv, opts);
+
+    int core_to_pin = 0;
+    size_t bytes = 0;
+    long long accesses = 1LL << 22;
+    std::string patterns = "forward,backward,tiled,page,prefetch";
+    const char *out_path = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:m:n:p:o:")) != -1) {
+        switch (opt) {
+        case 'c': core_to_pin = std::atoi(optarg); break;
+        case 'm': bytes = std::strtoull(optarg, nullptr, 0); break;
+        case 'n': accesses = std::max(1LL, std::atoll(optarg)); break;
+        case 'p': patterns = optarg; break;
+        case 'o': out_path = optarg; break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [-c core] [-m bytes] [-n accesses] [-p forward,backward,tiled,page,prefetch] [-o out.csv]"
+                         " [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]" << std::endl;
+            return 1;
+        }
+    }
+
+    // --- CPU Pinning (done by the harness) ---
+    opts.cpu = core_to_pin;
+    bench::Harness h("stride", opts);
+
+    auto caches = bench::discover_caches(core_to_pin);
+    const size_t line = bench::line_size(caches);
+    const size_t max_stride = 64 << 10;
+    if (bytes == 0)
+        bytes = 4 * bench::llc_size(caches);
+    bytes = std::max(bytes, 16 * max_stride);
+
+    // Huge pages where THP allows, so that TLB misses stay out of the numbers
+    // for strides under 2 MiB. Written once, so every page is real memory
+    // rather than the shared zero page.
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise(p, bytes, MADV_HUGEPAGE);
+    std::memset(p, 0, bytes);
+    const uint8_t *buf = static_cast<const uint8_t *>(p);
+
+    FILE *out = out_path ? std::fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    bench::print_caches(caches, out);
+    std::fprintf(out, "# buffer %zu MiB, %lld accesses per point\n", bytes >> 20, accesses);
+    std::fprintf(out, "pattern,stride,prefetch,mode,ns_per_access,ci_lo,ci_hi\n");
+
+    struct Run { const char *name; Pattern pattern; std::vector<int> distances; };
+    const std::vector<Run> runs = {
+        {"forward", Pattern::Forward, {0}},
+        {"backward", Pattern::Backward, {0}},
+        {"tiled", Pattern::Tiled, {0}},
+        {"page", Pattern::Page, {0}},
+        {"prefetch", Pattern::Forward, {1, 2, 4, 8, 16, 32, 64}},
+    };
+    std::mt19937_64 rng(12345);
+    for (const Run &r : runs) {
+        if (patterns.find(r.name) == std::string::npos)
+            continue;
+        for (size_t stride = 8; stride <= max_stride; stride *= 2) {
+            // Random order of the stride slots in a page, shared by all pages
+            std::vector<size_t> page_order;
+            for (size_t off = 0; off < std::max<size_t>(4096, stride); off += stride)
+                page_order.push_back(off);
+            std::shuffle(page_order.begin(), page_order.end(), rng);
+
+            for (int d : r.distances) {
+                for (bool dep : {false, true}) {
+                    const char *name = r.name == std::string("prefetch") ? "forward" : r.name;
+                    const bench::Stats &s = h.per(accesses).measure(
+                        std::string(name) + "/" + std::to_string(stride) + "/" + std::to_string(d) +
+                            (dep ? "/dep" : "/indep"),
+                        "ns", [&] {
+                            return dep ? run<true>(r.pattern, buf, bytes, stride, d, accesses, line, page_order)
+                                       : run<false>(r.pattern, buf, bytes, stride, d, accesses, line, page_order);
+                        });
+                    std::fprintf(out, "%s,%zu,%d,%s,%.3f,%.3f,%.3f\n", name, stride, d, dep ? "dep" : "indep",
+                                 s.median, s.ci_lo, s.ci_hi);
+                    std::fflush(out);
+                }
+            }
+        }
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    munmap(p, bytes);
+    h.finish();
+    return 0;
+}
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "include/affinity.h"
+#include "include/cache_info.h"
+#include "include/bench.h"
+#include "include/chase.h"
+
+// TLB reach and page-walk cost. The chase loads one cache line per stride
+// (4 KiB by default) across a growing number of strides, so the number of
+// distinct 4 KiB pages touched grows while the number of lines stays small.
+// The same chase runs over memory backed by:
+//   4k       4 KiB pages only: one TLB entry per load once the set is big
+//   thp      transparent 2 MiB pages (MADV_HUGEPAGE), if THP allows them
+//   hugetlb  MAP_HUGETLB 2 MiB pages, if the pool has enough free
+// The lines touched, and so the cache misses, are the same for every backing,
+// so the gap between 4k and the huge-page runs is the translation cost:
+// flat while the pages fit the L1 dTLB, a step at the L1 dTLB reach, another
+// at the STLB reach, and beyond that a page walk on every load. Writes
+//   pages,bytes,ns_4k,ns_thp,ns_hugetlb,walk_ns
+// CSV (walk_ns = 4k minus the faster huge-page run); steps are listed at the end.
+// Each point runs under the include/bench.h harness and the CSV has its
+// median; --json has the confidence intervals and per-load counters.
+//
+// usage: tlb [-c core] [-s stride] [-m max_pages] [-p points_per_octave] [-n loads] [-o out.csv]
+//            [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]
+
+// KiB of this process's anonymous memory in transparent huge pages
+long anon_huge_kib() {
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string key;
+    long kib;
+    while (in >> key) {
+        if (key == "AnonHugePages:" && in >> kib)
+            return kib;
+        in.ignore(1 << 10, '\n');
+    }
+    return -1;
+}
+
+std::string read_line(const char *path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+int main(int argc, char **argv) {
+    bench::Options opts;
+    opts.warmup = 1;
+    opts.reps = 5;
+    opts = bench::parse_args(argc, argv, opts);
+
+    int core_to_pin = 0;
+    size_t stride = 4096;
+    size_t max_pages = 1 << 16;
+    int points_per_octave = 2;
+    long long loads = 1LL << 22;
+    const char *out_path = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:m:p:n:o:")) != -1) {
+        switch (opt) {
+        case 'c': core_to_pin = std::atoi(optarg); break;
+        case 's': stride = std::strtoull(optarg, nullptr, 0); break;
+        case 'm': max_pages = std::max(1ULL, std::strtoull(optarg, nullptr, 0)); break;
+        case 'p': points_per_octave = std::max(1, std::atoi(optarg)); break;
+        case 'n': loads = std::max(8LL, std::atoll(optarg)); break;
+        case 'o': out_path = optarg; break;
+        default:
+            std::cerr << "usage: " << argv[0]
+                      << " [-c core] [-s stride] [-m max_pages] [-p points_per_octave] [-n loads] [-o out.csv]"
+                         " [--reps=N] [--warmup=N] [--json=FILE] [--no-counters]" << std::endl;
+            return 1;
+        }
+    }
+
+    // --- CPU Pinning (done by the harness) ---
+    opts.cpu = core_to_pin;
+    bench::Harness h("tlb", opts);
+
+    auto caches = bench::discover_caches(core_to_pin);
+    const size_t line = bench::line_size(caches);
+    const size_t bytes = max_pages * stride;
+
+    FILE *out = out_path ? std::fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    bench::print_caches(caches, out);
+    std::fprintf(out, "# thp: %s\n", read_line("/sys/kernel/mm/transparent_hugepage/enabled").c_str());
+
+    // --- Page counts: points_per_octave per doubling, from 1 to max_pages ---
+    std::vector<size_t> counts;
+    for (int k = 0;; ++k) {
+        size_t n = static_cast<size_t>(std::pow(2.0, double(k) / points_per_octave));
+        if (n > max_pages)
+            break;
+        if (counts.empty() || n != counts.back())
+            counts.push_back(n);
+    }
+
+    // --- Sweep each backing; a missing one is left as an empty column ---
+    const bench::Backing backings[] = {bench::Backing::Small, bench::Backing::Transparent,
+                                       bench::Backing::HugeTLB};
+    const char *backing_names[] = {"4k", "thp", "hugetlb"};
+    std::vector<std::vector<double>> ns(3);
+    for (int b = 0; b < 3; ++b) {
+        if (backings[b] == bench::Backing::HugeTLB && !bench::hugetlb_available(bytes)) {
+            std::fprintf(out, "# hugetlb: not enough free huge pages for %zu MiB "
+                              "(see /proc/sys/vm/nr_hugepages)\n", bytes >> 20);
+            continue;
+        }
+        long huge_before = anon_huge_kib();
+        bench::Chase chase(bytes, backings[b]);
+        for (size_t n : counts) {
+            chase.link_strided(n, stride, line);
+            long long steps = std::max<long long>(loads, 2 * (long long)n);
+            ns[b].push_back(h.per(steps).measure(std::string(backing_names[b]) + "/" + std::to_string(n), "ns",
+                                                 [&] { return chase.ns_per_load(steps, 1, false); }).median);
+        }
+        if (backings[b] == bench::Backing::Transparent) {
+            long huge = anon_huge_kib() - huge_before;
+            std::fprintf(out, "# thp: %ld of %zu KiB in huge pages\n", huge, bytes >> 10);
+            if (huge <= 0)
+                ns[b].clear();
+        }
+    }
+
+    std::fprintf(out, "pages,bytes,ns_4k,ns_thp,ns_hugetlb,walk_ns\n");
+    std::vector<double> walk(counts.size(), NAN), huge_best(counts.size(), NAN);
+    for (size_t i = 0; i < counts.size(); ++i) {
+        std::fprintf(out, "%zu,%zu", counts[i], counts[i] * stride);
+        for (int b = 0; b < 3; ++b) {
+            if (ns[b].empty())
+                std::fprintf(out, ",");
+            else
+                std::fprintf(out, ",%.3f", ns[b][i]);
+            if (b > 0 && !ns[b].empty())
+                huge_best[i] = std::fmin(huge_best[i], ns[b][i]);
+        }
+        if (!std::isnan(huge_best[i])) {
+            walk[i] = ns[0][i] - huge_best[i];
+            std::fprintf(out, ",%.3f", walk[i]);
+        } else {
+            std::fprintf(out, ",");
+        }
+        std::fprintf(out, "\n");
+    }
+
+    // --- Steps: 4k latency jumps that the huge-page runs don't share ---
+    // Without a huge-page run to compare against, cache and TLB steps can't
+    // be told apart, so nothing is reported.
+    const char *step_names[] = {"L1 dTLB reach", "STLB reach"};
+    int steps = 0;
+    for (size_t i = 1; i < counts.size() && !std::isnan(huge_best[0]); ++i) {
+        bool jump_4k = ns[0][i] > 1.25 * ns[0][i - 1];
+        bool jump_huge = huge_best[i] > 1.10 * huge_best[i - 1];
+        if (jump_4k && !jump_huge) {
+            std::fprintf(out, "# step: %s ~%zu pages (%zu KiB spanned), +%.1f ns\n",
+                         steps < 2 ? step_names[steps] : "further step", counts[i - 1],
+                         counts[i - 1] * stride >> 10, ns[0][i] - ns[0][i - 1]);
+            ++steps;
+        }
+    }
+    if (!std::isnan(walk.back()))
+        std::fprintf(out, "# page walk at %zu pages: %.1f ns per load\n", counts.back(), walk.back());
+
+    if (out != stdout)
+        std::fclose(out);
+    h.finish();
+    return 0;
+}